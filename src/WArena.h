@@ -0,0 +1,174 @@
+#ifndef W_ARENA_H
+#define W_ARENA_H
+
+#include <Arduino.h>
+
+#include <new>
+
+#ifdef ARDUINO_ARCH_ESP32
+#include <soc/soc.h>
+#endif
+
+#define ARENA_CHUNK_SIZE 1024
+// chunks double up to this size, so a big page needs only a few of them
+#define ARENA_CHUNK_SIZE_MAX 4096
+#define ARENA_ALIGNMENT 8
+
+struct WArenaChunk {
+  WArenaChunk* next;
+  size_t size;
+  size_t used;
+  // data follows
+  uint8_t* data() { return (uint8_t*)(this + 1); }
+};
+
+/*
+  Bump allocator for objects that live and die together, e.g. the control tree
+  of a web page. Allocating is a pointer increment; nothing is freed one by
+  one, all chunks are released at once when the arena is deleted. Strings in
+  flash (ESP32) or in read-only data (ESP8266) are referenced, not copied.
+  Classes with arena support allocate from it while its WArenaScope is active.
+  Owners free their parts with destroy() and freeString() of their arena,
+  which skip what is part of it. Nothing is shared between arenas, so pages
+  of different tasks don't need a lock; the current arena is per task.
+*/
+class WArena {
+ public:
+  WArena() {}
+
+  ~WArena() {
+    WArenaChunk* chunk = _chunks;
+    while (chunk != nullptr) {
+      WArenaChunk* next = chunk->next;
+      ::operator delete(chunk);
+      chunk = next;
+    }
+    if (_current == this) _current = nullptr;
+  }
+
+  void* allocate(size_t size) {
+    size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+    if ((_chunks == nullptr) || (_chunks->used + size > _chunks->size)) {
+      size_t chunkSize = (_chunks == nullptr ? ARENA_CHUNK_SIZE : min(_chunks->size * 2, (size_t)ARENA_CHUNK_SIZE_MAX));
+      chunkSize = max(size, chunkSize);
+      WArenaChunk* chunk = (WArenaChunk*)::operator new(sizeof(WArenaChunk) + chunkSize);
+      chunk->next = _chunks;
+      chunk->size = chunkSize;
+      chunk->used = 0;
+      _chunks = chunk;
+      _reserved += chunkSize;
+      if ((_low == nullptr) || ((uint8_t*)chunk < _low)) _low = (uint8_t*)chunk;
+      if ((uint8_t*)chunk->data() + chunkSize > _high) _high = chunk->data() + chunkSize;
+    }
+    void* result = _chunks->data() + _chunks->used;
+    _chunks->used += size;
+    _allocations++;
+    _used += size;
+    return result;
+  }
+
+  // Null terminated copy, static strings are returned as they are
+  const char* copy(const char* text) {
+    if ((text == nullptr) || (isStatic(text))) return text;
+    char* result = (char*)allocate(strlen_P(text) + 1);
+    strcpy_P(result, text);
+    return result;
+  }
+
+  template <class T, typename... Args>
+  T* create(Args... args) {
+    return new (allocate(sizeof(T))) T(args...);
+  }
+
+  bool owns(const void* p) {
+    if ((p < _low) || (p >= _high)) return false;
+    for (WArenaChunk* chunk = _chunks; chunk != nullptr; chunk = chunk->next) {
+      if ((p >= chunk->data()) && (p < chunk->data() + chunk->size)) return true;
+    }
+    return false;
+  }
+
+  uint32_t allocations() { return _allocations; }
+
+  size_t used() { return _used; }
+
+  size_t reserved() { return _reserved; }
+
+  static WArena* current() { return _current; }
+
+  static void current(WArena* arena) { _current = arena; }
+
+  // arena, if it's the current one. Later changes of arena objects go to heap, so a long living arena doesn't grow
+  static WArena* ifCurrent(WArena* arena) { return ((arena != nullptr) && (arena == _current) ? arena : nullptr); }
+
+  // From the current arena if any, otherwise from heap
+  static void* allocateCurrent(size_t size) {
+    return (_current != nullptr ? _current->allocate(size) : ::operator new(size));
+  }
+
+  // Deletes object, if it's not part of arena; arena objects are only destructed
+  template <class T>
+  static void destroy(WArena* arena, T* object) {
+    if (object == nullptr) return;
+    if ((arena != nullptr) && (arena->owns(object))) {
+      object->~T();
+    } else {
+      delete object;
+    }
+  }
+
+  // Frees a string copy, if it's not part of arena or static
+  static void freeString(WArena* arena, const char* text) {
+    if ((text != nullptr) && (!isStatic(text)) && ((arena == nullptr) || (!arena->owns(text)))) delete[] text;
+  }
+
+  // True for string literals and constants, which never need a copy
+  static bool isStatic(const void* p) {
+#ifdef ARDUINO_ARCH_ESP8266
+    // PROGMEM in flash can't be read by byte, only read-only data in RAM qualifies
+    extern char _rodata_start, _rodata_end;
+    return ((p >= &_rodata_start) && (p < &_rodata_end));
+#elif defined(ARDUINO_ARCH_ESP32)
+    return (((uint32_t)p >= SOC_DROM_LOW) && ((uint32_t)p < SOC_DROM_HIGH));
+#else
+    return false;
+#endif
+  }
+
+ private:
+  WArenaChunk* _chunks = nullptr;
+  uint32_t _allocations = 0;
+  size_t _used = 0;
+  size_t _reserved = 0;
+  // bounds of all chunks, most foreign pointers are outside
+  uint8_t* _low = nullptr;
+  uint8_t* _high = nullptr;
+#ifdef ARDUINO_ARCH_ESP32
+  // per task, the async web server builds pages in its own
+  static thread_local WArena* _current;
+#else
+  static WArena* _current;
+#endif
+};
+
+#ifdef ARDUINO_ARCH_ESP32
+thread_local WArena* WArena::_current = nullptr;
+#else
+WArena* WArena::_current = nullptr;
+#endif
+
+// Makes arena the current arena until end of the enclosing scope
+class WArenaScope {
+ public:
+  WArenaScope(WArena* arena) {
+    _previous = WArena::current();
+    WArena::current(arena);
+  }
+
+  ~WArenaScope() { WArena::current(_previous); }
+
+ private:
+  WArena* _previous;
+};
+
+#endif
@@ -0,0 +1,250 @@
+#ifndef _WCBOR_H__
+#define _WCBOR_H__
+
+#include "Arduino.h"
+#include "WJson.h"
+
+/*
+  CBOR (RFC 8949) writer with the same fluent interface as WJson.
+  Objects and arrays are written with indefinite length (0xBF/0x9F ... 0xFF),
+  so the output can be streamed exactly like JSON without counting members first.
+*/
+
+#define CBOR_UNSIGNED 0x00
+#define CBOR_NEGATIVE 0x20
+#define CBOR_BYTES 0x40
+#define CBOR_TEXT 0x60
+#define CBOR_ARRAY 0x80
+#define CBOR_MAP 0xA0
+#define CBOR_TAG 0xC0
+#define CBOR_SIMPLE 0xE0
+#define CBOR_FALSE 0xF4
+#define CBOR_TRUE 0xF5
+#define CBOR_NULL 0xF6
+#define CBOR_FLOAT16 0xF9
+#define CBOR_FLOAT32 0xFA
+#define CBOR_FLOAT64 0xFB
+#define CBOR_INDEFINITE 0x1F
+#define CBOR_BREAK 0xFF
+
+enum WPayloadFormat {
+  PAYLOAD_JSON,
+  PAYLOAD_CBOR
+};
+
+class WCbor : public WJson {
+ public:
+  WCbor(Print* stream) : WJson(stream) {}
+
+  static WJson* create(Print* stream, WPayloadFormat format) {
+    return (format == PAYLOAD_CBOR ? new WCbor(stream) : new WJson(stream));
+  }
+
+  virtual WJson& beginObject() {
+    _stream->write((uint8_t)(CBOR_MAP | CBOR_INDEFINITE));
+    return *this;
+  }
+
+  virtual WJson& beginObject(const char* name) {
+    if ((name != nullptr) && (name[0] != '\0')) {
+      memberName(name);
+    }
+    return beginObject();
+  }
+
+  virtual WJson& memberName(const char* name) {
+    if (name != nullptr) {
+      _text(name);
+    }
+    return *this;
+  }
+
+  virtual WJson& separator() { return *this; }
+
+  virtual WJson& endObject() {
+    _stream->write((uint8_t)CBOR_BREAK);
+    return *this;
+  }
+
+  virtual WJson& beginArray() {
+    _stream->write((uint8_t)(CBOR_ARRAY | CBOR_INDEFINITE));
+    return *this;
+  }
+
+  virtual WJson& beginArray(const char* name) {
+    memberName(name);
+    return beginArray();
+  }
+
+  virtual WJson& endArray() {
+    _stream->write((uint8_t)CBOR_BREAK);
+    return *this;
+  }
+
+  virtual WJson& propertyNull(const char* name) {
+    memberName(name);
+    return null();
+  }
+
+  virtual WJson& propertyBoolean(const char* name, bool value) {
+    memberName(name);
+    _stream->write((uint8_t)(value ? CBOR_TRUE : CBOR_FALSE));
+    return *this;
+  }
+
+  virtual WJson& propertyValue(const char* name, WValue* value, byte precision = DOUBLE_DEFAULT_PRECISION) {
+    memberName(name);
+    return pValue(value, precision);
+  }
+
+  virtual WJson& pValue(WValue* value, byte precision = DOUBLE_DEFAULT_PRECISION) {
+    if ((value == nullptr) || (value->isNull())) {
+      return null();
+    }
+    switch (value->type()) {
+      case WDataType::BOOLEAN:
+        _stream->write((uint8_t)(value->asBool() ? CBOR_TRUE : CBOR_FALSE));
+        break;
+      case WDataType::DOUBLE:
+        _double(value->asDouble(), precision);
+        break;
+      case WDataType::INTEGER:
+        _integer(value->asInt());
+        break;
+      case WDataType::SHORT:
+        _integer(value->asShort());
+        break;
+      case WDataType::UNSIGNED_SHORT:
+        _head(CBOR_UNSIGNED, value->asUnsignedShort());
+        break;
+      case WDataType::UNSIGNED_LONG:
+        _head(CBOR_UNSIGNED, value->asUnsignedLong());
+        break;
+      case WDataType::BYTE:
+        _head(CBOR_UNSIGNED, value->asByte());
+        break;
+      case WDataType::STRING:
+        _text(value->asString());
+        break;
+      case WDataType::BYTE_ARRAY:
+        _head(CBOR_ARRAY, value->length());
+        for (byte i = 0; i < value->length(); i++) {
+          _head(CBOR_UNSIGNED, value->byteArrayValue(i));
+        }
+        break;
+      default:
+        null();
+    }
+    return *this;
+  }
+
+  virtual WJson& propertyString(const char* name, const char* value, ...) {
+    memberName(name);
+    va_list arg;
+    va_start(arg, value);
+    _texts(value, arg);
+    va_end(arg);
+    return *this;
+  }
+
+  virtual WJson& string(const char* text, ...) {
+    va_list arg;
+    va_start(arg, text);
+    _texts(text, arg);
+    va_end(arg);
+    return *this;
+  }
+
+  virtual WJson& onlyString(const char* text1) {
+    if (text1 != nullptr) _text(text1);
+    return *this;
+  }
+
+  virtual WJson& null() {
+    _stream->write((uint8_t)CBOR_NULL);
+    return *this;
+  }
+
+ private:
+  void _head(byte major, uint64_t value) {
+    uint8_t buffer[9];
+    byte length;
+    if (value < 24) {
+      buffer[0] = major | (byte)value;
+      length = 1;
+    } else if (value <= 0xFF) {
+      buffer[0] = major | 24;
+      length = 2;
+    } else if (value <= 0xFFFF) {
+      buffer[0] = major | 25;
+      length = 3;
+    } else if (value <= 0xFFFFFFFF) {
+      buffer[0] = major | 26;
+      length = 5;
+    } else {
+      buffer[0] = major | 27;
+      length = 9;
+    }
+    for (byte i = length - 1; i > 0; i--) {
+      buffer[i] = (uint8_t)(value & 0xFF);
+      value >>= 8;
+    }
+    _stream->write(buffer, length);
+  }
+
+  void _integer(long value) {
+    if (value < 0) {
+      _head(CBOR_NEGATIVE, (uint64_t)(-1 - value));
+    } else {
+      _head(CBOR_UNSIGNED, (uint64_t)value);
+    }
+  }
+
+  void _double(double value, byte precision) {
+    float f = (float)value;
+    if ((isnan(value)) || (isinf(value)) || (WValue::isDoubleEqual(value, f, 0.5 / pow(10, precision)))) {
+      // single precision is enough for the declared decimals
+      uint32_t bits;
+      memcpy(&bits, &f, sizeof(bits));
+      _stream->write((uint8_t)CBOR_FLOAT32);
+      _bigEndian(bits, 4);
+    } else {
+      uint64_t bits;
+      memcpy(&bits, &value, sizeof(bits));
+      _stream->write((uint8_t)CBOR_FLOAT64);
+      _bigEndian(bits, 8);
+    }
+  }
+
+  void _bigEndian(uint64_t value, byte length) {
+    uint8_t buffer[8];
+    for (int i = length - 1; i >= 0; i--) {
+      buffer[i] = (uint8_t)(value & 0xFF);
+      value >>= 8;
+    }
+    _stream->write(buffer, length);
+  }
+
+  void _text(const char* text) {
+    size_t length = strlen(text);
+    _head(CBOR_TEXT, length);
+    _stream->write((const uint8_t*)text, length);
+  }
+
+  // concatenates a nullptr terminated list of texts to one text item
+  void _texts(const char* text, va_list arg) {
+    va_list count;
+    va_copy(count, arg);
+    size_t length = 0;
+    for (const char* t = text; t != nullptr; t = va_arg(count, const char*)) {
+      length += strlen(t);
+    }
+    va_end(count);
+    _head(CBOR_TEXT, length);
+    for (const char* t = text; t != nullptr; t = va_arg(arg, const char*)) {
+      _stream->write((const uint8_t*)t, strlen(t));
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,252 @@
+#ifndef _WCBOR_PARSER_H__
+#define _WCBOR_PARSER_H__
+
+#include <limits.h>
+
+#include "Arduino.h"
+#include "WCbor.h"
+
+// nested maps, arrays and tags; deeper payloads are rejected instead of overflowing the stack
+#define CBOR_MAX_DEPTH 8
+
+/*
+  Reads a CBOR map into the same structure as WJsonParser::asMap:
+  a WList<WValue> with string values, nested maps and arrays as list values.
+  Numbers and booleans are converted to their text representation, so
+  existing consumers can keep using WProperty::parse(value->asString()).
+*/
+
+class WCborParser {
+ public:
+  typedef std::function<void(const char* key, const char* value)> TOnKeyValue;
+
+  WCborParser(const uint8_t* payload, size_t length) {
+    _data = payload;
+    _length = length;
+    _pos = 0;
+  }
+
+  static WList<WValue>* asMap(const uint8_t* payload, size_t length) {
+    WCborParser cp = WCborParser(payload, length);
+    return cp.parse();
+  }
+
+  // Streams the members of the top level map to onKeyValue, nothing is collected for them
+  static void forEachKeyValue(const uint8_t* payload, size_t length, TOnKeyValue onKeyValue) {
+    WCborParser cp = WCborParser(payload, length);
+    cp._onKeyValue = onKeyValue;
+    delete cp.parse();
+  }
+
+  // Text of a single top level item (a property value), nothing if it's no number, text or boolean
+  static void forValue(const uint8_t* payload, size_t length, std::function<void(const char* value)> onValue) {
+    WCborParser cp = WCborParser(payload, length);
+    WList<WValue>* result = new WList<WValue>();
+    if ((cp._parseValue(result, nullptr)) && (result->size() == 1)) {
+      WValue* value = result->get(0);
+      if (value->type() == WDataType::STRING) onValue(value->asString());
+    }
+    delete result;
+  }
+
+  WList<WValue>* parse() {
+    HEAP_TAG(HEAP_JSON);
+    WList<WValue>* result = new WList<WValue>();
+    if ((_pos < _length) && ((_data[_pos] & 0xE0) == CBOR_MAP)) {
+      if (!_parseContainer(result, true)) {
+        LOG->error(F("cborParser: unexpected end of payload"));
+      }
+    }
+    return result;
+  }
+
+ private:
+  const uint8_t* _data;
+  size_t _length;
+  size_t _pos;
+  TOnKeyValue _onKeyValue = nullptr;
+  byte _depth = 0;
+
+  bool _readHead(byte& major, byte& info, uint64_t& value) {
+    if (_pos >= _length) return false;
+    byte initial = _data[_pos++];
+    major = initial & 0xE0;
+    info = initial & 0x1F;
+    value = info;
+    if (info >= 24 && info <= 27) {
+      byte count = 1 << (info - 24);
+      if (_pos + count > _length) return false;
+      value = 0;
+      for (byte i = 0; i < count; i++) {
+        value = (value << 8) | _data[_pos++];
+      }
+    }
+    return true;
+  }
+
+  bool _isBreak() {
+    return ((_pos < _length) && (_data[_pos] == CBOR_BREAK));
+  }
+
+  // map or array at current position; values are added to target
+  bool _parseContainer(WList<WValue>* target, bool isMap) {
+    byte major, info;
+    uint64_t count;
+    if (!_readHead(major, info, count)) return false;
+    bool indefinite = (info == CBOR_INDEFINITE);
+    if (_depth >= CBOR_MAX_DEPTH) {
+      LOG->error(F("cborParser: nested too deep"));
+      return false;
+    }
+    _depth++;
+    for (uint64_t i = 0; (indefinite) || (i < count); i++) {
+      if ((indefinite) && (_isBreak())) {
+        _pos++;
+        _depth--;
+        return true;
+      }
+      char* key = nullptr;
+      if (isMap) {
+        key = _readText();
+        if (key == nullptr) return false;
+      }
+      bool ok = _parseValue(target, key);
+      if (key) delete[] key;
+      if (!ok) return false;
+    }
+    _depth--;
+    return true;
+  }
+
+  void _add(WList<WValue>* target, const char* key, const char* value) {
+    if ((_onKeyValue) && (_depth == 1) && (key != nullptr)) {
+      _onKeyValue(key, value);
+    } else {
+      target->add(new WValue(value), key);
+    }
+  }
+
+  bool _parseValue(WList<WValue>* target, const char* key) {
+    // tags only annotate the following item, they are skipped
+    for (byte tags = 0; (_pos < _length) && ((_data[_pos] & 0xE0) == CBOR_TAG); tags++) {
+      byte major, info;
+      uint64_t tag;
+      if ((tags >= CBOR_MAX_DEPTH) || (!_readHead(major, info, tag))) return false;
+    }
+    if (_pos >= _length) return false;
+    byte major = _data[_pos] & 0xE0;
+    if (major == CBOR_MAP || major == CBOR_ARRAY) {
+      WList<WValue>* list = new WList<WValue>();
+      if (!_parseContainer(list, (major == CBOR_MAP))) {
+        delete list;
+        return false;
+      }
+      target->add(new WValue(list), key);
+      return true;
+    } else if (major == CBOR_TEXT) {
+      char* text = _readText();
+      if (text == nullptr) return false;
+      _add(target, key, text);
+      delete[] text;
+      return true;
+    }
+    byte info;
+    uint64_t value;
+    if (!_readHead(major, info, value)) return false;
+    WStringStream number(24);
+    switch (major) {
+      case CBOR_UNSIGNED:
+      case CBOR_NEGATIVE:
+        // integers beyond long / unsigned long are rejected instead of truncated
+        if (value > (major == CBOR_UNSIGNED ? (uint64_t)ULONG_MAX : (uint64_t)LONG_MAX)) {
+          LOG->error(F("cborParser: integer out of range, '%s' skipped"), (key ? key : ""));
+          return true;
+        }
+        if (major == CBOR_UNSIGNED) {
+          WValue::numberUnsigned(&number, (unsigned long)value);
+        } else {
+          WValue::numberInt(&number, -1 - (long)value);
+        }
+        break;
+      case CBOR_BYTES:
+        // byte strings are not supported, skip
+        if (value > _length - _pos) return false;
+        _pos += (size_t)value;
+        return true;
+      case CBOR_SIMPLE: {
+        if (info == (CBOR_TRUE & 0x1F)) {
+          _add(target, key, WC_TRUE);
+        } else if (info == (CBOR_FALSE & 0x1F)) {
+          _add(target, key, WC_FALSE);
+        } else if ((info >= 25) && (info <= 27)) {
+          WValue::numberDouble(&number, _toDouble(info, value), (info == 27 ? DOUBLE_MAX_PRECISION : 6));
+          _add(target, key, number.c_str());
+        }
+        // null and undefined are skipped like in WJsonParser
+        return true;
+      }
+    }
+    _add(target, key, number.c_str());
+    return true;
+  }
+
+  double _toDouble(byte info, uint64_t bits) {
+    switch (info) {
+      case 25: {
+        // half precision
+        int exponent = (bits >> 10) & 0x1F;
+        int mantissa = bits & 0x3FF;
+        double result = (exponent == 0 ? ldexp(mantissa, -24) : (exponent != 31 ? ldexp(mantissa + 1024, exponent - 25) : (mantissa == 0 ? INFINITY : NAN)));
+        return ((bits & 0x8000) ? -result : result);
+      }
+      case 26: {
+        uint32_t b = (uint32_t)bits;
+        float f;
+        memcpy(&f, &b, sizeof(f));
+        return f;
+      }
+      default: {
+        double d;
+        memcpy(&d, &bits, sizeof(d));
+        return d;
+      }
+    }
+  }
+
+  // returns a new null terminated copy of the text item at current position
+  char* _readText() {
+    byte major, info;
+    uint64_t length;
+    if ((!_readHead(major, info, length)) || (major != CBOR_TEXT)) return nullptr;
+    if (info != CBOR_INDEFINITE) {
+      if (length > _length - _pos) return nullptr;
+      char* result = new char[length + 1];
+      memcpy(result, &_data[_pos], length);
+      result[length] = '\0';
+      _pos += length;
+      return result;
+    }
+    // indefinite text: concatenation of definite chunks
+    size_t start = _pos;
+    size_t total = 0;
+    while (!_isBreak()) {
+      if ((!_readHead(major, info, length)) || (major != CBOR_TEXT) || (info == CBOR_INDEFINITE) || (length > _length - _pos)) return nullptr;
+      total += length;
+      _pos += length;
+    }
+    _pos = start;
+    char* result = new char[total + 1];
+    size_t offset = 0;
+    while (!_isBreak()) {
+      _readHead(major, info, length);
+      memcpy(&result[offset], &_data[_pos], length);
+      offset += length;
+      _pos += length;
+    }
+    _pos++;
+    result[total] = '\0';
+    return result;
+  }
+};
+
+#endif
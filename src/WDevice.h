@@ -92,14 +92,23 @@ class WDevice : public IWGpioRegister, public IWPropertyRegister {
   }
 
   virtual void loop(unsigned long now) {
-    if (_gpios != nullptr) {
-      //inputs first
-      _gpios->forEach([this, now] (int index, WGpio* gpio, const char* id) { if (gpio->isInput()) gpio->loop(now); } );
-      //all others after
-      _gpios->forEach([this, now] (int index, WGpio* gpio, const char* id) { if (!gpio->isInput()) gpio->loop(now); } );
-    }
+    //inputs first, all others after; only gpios that are due
+    _inputs.loop(now);
+    _outputs.loop(now);
+  }
+
+  // Milliseconds until a gpio of this device needs the next loop.
+  // Devices that poll something in their own loop should override this.
+  virtual unsigned long timeUntilNextLoop(unsigned long now) {
+    return min(_inputs.timeUntilNextDue(now), _outputs.timeUntilNextDue(now));
   }
 
+#ifdef W_PROFILER
+  byte profileSlot() { return _profileSlot; }
+
+  void profileSlot(byte slot) { _profileSlot = slot; }
+#endif
+
   virtual void bindWebServerCalls(AsyncWebServer* webServer) {}
 
   virtual void handleUnknownMqttCallback(bool getState, String completeTopic,
@@ -159,6 +168,10 @@ class WDevice : public IWGpioRegister, public IWPropertyRegister {
       _gpios = new WList<WGpio>();
     }
     _gpios->add(gpio);
+    (gpio->isInput() ? _inputs : _outputs).add(gpio);
+#ifdef W_PROFILER
+    if (gpio->type() != GPIO_TYPE_UNKNOWN) gpio->profileSlot(PROFILE_SLOT((const char*)pgm_read_ptr(&S_GPIO_TYPE[gpio->type()]), gpio->pin()));
+#endif
   }
 
  protected:  
@@ -169,6 +182,9 @@ class WDevice : public IWGpioRegister, public IWPropertyRegister {
   WPropertyVisibility _visibility;
   WList<WProperty>* _properties;
   const char* _id;
+#ifdef W_PROFILER
+  byte _profileSlot = PROFILE_NO_SLOT;
+#endif
   const char* _title;
   const char* _type;
   const char* _alternativeType;
@@ -176,6 +192,8 @@ class WDevice : public IWGpioRegister, public IWPropertyRegister {
   unsigned long _stateNotifyInterval;
   bool _lastStateWaitForResponse;
   WList<WGpio>* _gpios = nullptr;  
+  WScheduler _inputs;
+  WScheduler _outputs;
 
   void onPropertyChange() { _lastStateNotify = 0; }
 };
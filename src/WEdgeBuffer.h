@@ -0,0 +1,81 @@
+#ifndef W_EDGE_BUFFER_H
+#define W_EDGE_BUFFER_H
+
+#include <Arduino.h>
+
+#ifndef NO_PIN
+#define NO_PIN 0xFF
+#endif
+// must be a power of two
+#define EDGE_BUFFER_SIZE 32
+
+struct WEdge {
+  unsigned long time;
+  // bit 0: level of pin, bit 1: level of second pin
+  byte level;
+};
+
+/*
+  Lock-free single producer / single consumer ring of timestamped input edges.
+  The pin interrupt pushes, the gpio loop pops. If the loop can't keep up,
+  new edges are dropped and overflowed() is set, the loop should resync then.
+*/
+class WEdgeBuffer {
+ public:
+  WEdgeBuffer(byte pin, byte secondPin = NO_PIN) {
+    _pin = pin;
+    _secondPin = secondPin;
+  }
+
+  ~WEdgeBuffer() { detach(); }
+
+  void attach(int mode = CHANGE) {
+    attachInterruptArg(digitalPinToInterrupt(_pin), WEdgeBuffer::_isr, this, mode);
+  }
+
+  void detach() { detachInterrupt(digitalPinToInterrupt(_pin)); }
+
+  byte pin() { return _pin; }
+
+  bool empty() { return (_head == _tail); }
+
+  bool pop(WEdge& edge) {
+    byte tail = _tail;
+    if (_head == tail) return false;
+    edge.time = _times[tail & (EDGE_BUFFER_SIZE - 1)];
+    edge.level = _levels[tail & (EDGE_BUFFER_SIZE - 1)];
+    _tail = tail + 1;
+    return true;
+  }
+
+  // true, if edges were lost since last call
+  bool overflowed() {
+    bool result = _overflow;
+    _overflow = false;
+    return result;
+  }
+
+ private:
+  byte _pin, _secondPin;
+  volatile byte _head = 0;
+  volatile byte _tail = 0;
+  volatile bool _overflow = false;
+  volatile unsigned long _times[EDGE_BUFFER_SIZE];
+  volatile byte _levels[EDGE_BUFFER_SIZE];
+
+  static void IRAM_ATTR _isr(void* arg) { ((WEdgeBuffer*)arg)->_push(); }
+
+  void IRAM_ATTR _push() {
+    byte head = _head;
+    if ((byte)(head - _tail) >= EDGE_BUFFER_SIZE) {
+      _overflow = true;
+      return;
+    }
+    _times[head & (EDGE_BUFFER_SIZE - 1)] = millis();
+    _levels[head & (EDGE_BUFFER_SIZE - 1)] = digitalRead(_pin) | (_secondPin != NO_PIN ? digitalRead(_secondPin) << 1 : 0);
+    // publish the edge after its data is written
+    _head = head + 1;
+  }
+};
+
+#endif
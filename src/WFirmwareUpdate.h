@@ -0,0 +1,213 @@
+#ifndef W_FIRMWARE_UPDATE_H
+#define W_FIRMWARE_UPDATE_H
+
+#include <Arduino.h>
+#ifdef ARDUINO_ARCH_ESP8266
+#include <Updater.h>
+#elif ARDUINO_ARCH_ESP32
+#include <Update.h>
+#endif
+
+#include "WLog.h"
+#include "WSha256.h"
+
+// one flash sector, the image is written in chunks of this size
+#define OTA_CHUNK_SIZE 4096
+// an interrupted upload can be resumed within this time
+#define OTA_RESUME_TIMEOUT 300000
+
+// OTA_VERIFIED: complete and committed, checked against the digest if one was given
+enum WFirmwareUpdateState { OTA_IDLE, OTA_RUNNING, OTA_VERIFIED, OTA_FAILED };
+
+class WFirmwareUpdate;
+WFirmwareUpdate* FIRMWARE_UPDATE = nullptr;
+
+/*
+  Flash partition the image is written to. begin() gets size 0, if the
+  size isn't known in advance; maxSize bounds it then (0, if not even
+  that is known). Nothing is bootable before commit().
+*/
+class IWFlashTarget {
+ public:
+  virtual ~IWFlashTarget() {}
+
+  virtual bool begin(size_t size, int command, size_t maxSize) = 0;
+  virtual size_t write(uint8_t* data, size_t length) = 0;
+  virtual bool commit() = 0;
+  virtual void abort() = 0;
+};
+
+// Inactive app partition (or file system) via the Update class of the core
+class WUpdateTarget : public IWFlashTarget {
+ public:
+  virtual bool begin(size_t size, int command, size_t maxSize) {
+#ifdef ARDUINO_ARCH_ESP8266
+    Update.runAsync(true);
+    // without size the bound, without that all free sketch space. The file system partition may be smaller
+    if (size == 0) size = (maxSize > 0 ? maxSize : (ESP.getFreeSketchSpace() - 0x1000) & 0xFFFFF000);
+#elif ARDUINO_ARCH_ESP32
+    if (size == 0) size = UPDATE_SIZE_UNKNOWN;
+#endif
+    if (!Update.begin(size, command)) {
+      Update.printError(Serial);
+      return false;
+    }
+    return true;
+  }
+
+  virtual size_t write(uint8_t* data, size_t length) { return Update.write(data, length); }
+
+  virtual bool commit() {
+    if (!Update.end(true)) {
+      Update.printError(Serial);
+      return false;
+    }
+    return true;
+  }
+
+  virtual void abort() {
+#ifdef ARDUINO_ARCH_ESP32
+    Update.abort();
+#else
+    // the last chunk is never written before commit, so this can't finish the update
+    Update.end(false);
+#endif
+  }
+};
+
+/*
+  Streams a firmware image to a flash target in OTA_CHUNK_SIZE chunks while
+  SHA-256 is computed over the received bytes. The last chunk is held back
+  until the digest of the complete image matches, so a wrong or truncated
+  image is never marked bootable. Without an expected digest (the multipart
+  form upload) only the completeness is checked, the image is unverified.
+  If a transfer breaks, the state is kept: write() continues at offset(),
+  data before it is skipped, so a client can resume with a range request.
+  The session is dropped if it isn't resumed within OTA_RESUME_TIMEOUT.
+*/
+class WFirmwareUpdate {
+ public:
+  WFirmwareUpdate(IWFlashTarget* target) {
+    _target = target;
+    _buffer = nullptr;
+  }
+
+  ~WFirmwareUpdate() {
+    if (_state == OTA_RUNNING) _target->abort();
+    if (_buffer) delete[] _buffer;
+    delete _target;
+  }
+
+  // size 0, if unknown, maxSize bounds it then; sha256 as hex or nullptr, if the image isn't verified
+  bool begin(size_t size, const char* sha256, int command, size_t maxSize = 0) {
+    if (_state == OTA_RUNNING) _target->abort();
+    _state = OTA_FAILED;
+    _error = nullptr;
+    _size = size;
+    _maxSize = (size > 0 ? size : maxSize);
+    _offset = 0;
+    _bufferLength = 0;
+    _lastActivity = millis();
+    _sha.reset();
+    _verify = (sha256 != nullptr);
+    if ((_verify) && (!WSha256::fromHex(sha256, _expected))) return _fail("Invalid SHA-256");
+    if ((_buffer == nullptr) && ((_buffer = new (std::nothrow) uint8_t[OTA_CHUNK_SIZE]) == nullptr)) return _fail("Out of memory");
+    if (!_target->begin(size, command, maxSize)) return _fail("Can't start update");
+    LOG->notice(F("Update started, %d bytes"), size);
+    _state = OTA_RUNNING;
+    return true;
+  }
+
+  // Data at offset of the image. Bytes already received are skipped; false on a gap or a write error
+  bool write(size_t offset, const uint8_t* data, size_t length) {
+    if (_state != OTA_RUNNING) return false;
+    _lastActivity = millis();
+    if (offset > _offset) return false;
+    size_t skip = _offset - offset;
+    if (skip >= length) return true;
+    data += skip;
+    length -= skip;
+    if ((_maxSize > 0) && (_offset + length > _maxSize)) return _fail("Image larger than announced");
+    _sha.update(data, length);
+    _offset += length;
+    while (length > 0) {
+      // a full chunk is written when more data follows, the last one waits for finish()
+      if ((_bufferLength == OTA_CHUNK_SIZE) && (!_flush())) return false;
+      size_t l = min(length, (size_t)(OTA_CHUNK_SIZE - _bufferLength));
+      memcpy(_buffer + _bufferLength, data, l);
+      _bufferLength += l;
+      data += l;
+      length -= l;
+    }
+    return true;
+  }
+
+  // Verifies the image and makes it bootable
+  bool finish() {
+    if (_state != OTA_RUNNING) return false;
+    if ((_size > 0) && (_offset != _size)) return _fail("Image incomplete");
+    uint8_t digest[SHA256_SIZE];
+    _sha.finish(digest);
+    char hex[SHA256_HEX_LENGTH + 1];
+    WSha256::toHex(digest, hex);
+    if ((_verify) && (memcmp(digest, _expected, SHA256_SIZE) != 0)) {
+      LOG->error(F("Update SHA-256 mismatch: %s"), hex);
+      return _fail("SHA-256 mismatch");
+    }
+    if ((!_flush()) || (!_target->commit())) return _fail("Can't finish update");
+    LOG->notice(F("Update finished, %d bytes, SHA-256 %s%s"), _offset, hex, (_verify ? "" : " (not verified)"));
+    _state = OTA_VERIFIED;
+    return true;
+  }
+
+  void abort(const char* error) {
+    if (_state == OTA_RUNNING) _fail(error);
+  }
+
+  // Drops a session that wasn't resumed in time
+  void loop(unsigned long now) {
+    if ((_state == OTA_RUNNING) && (now - _lastActivity > OTA_RESUME_TIMEOUT)) abort("Update timed out");
+  }
+
+  WFirmwareUpdateState state() { return _state; }
+
+  bool isRunning() { return (_state == OTA_RUNNING); }
+
+  // Bytes received so far, where a resumed upload has to continue
+  size_t offset() { return _offset; }
+
+  size_t size() { return _size; }
+
+  const char* error() { return _error; }
+
+ private:
+  IWFlashTarget* _target;
+  WFirmwareUpdateState _state = OTA_IDLE;
+  const char* _error = nullptr;
+  size_t _size = 0;
+  size_t _maxSize = 0;
+  size_t _offset = 0;
+  uint8_t* _buffer;
+  size_t _bufferLength = 0;
+  unsigned long _lastActivity = 0;
+  WSha256 _sha;
+  bool _verify = false;
+  uint8_t _expected[SHA256_SIZE];
+
+  bool _flush() {
+    if (_bufferLength == 0) return true;
+    if (_target->write(_buffer, _bufferLength) != _bufferLength) return _fail("Can't write flash");
+    _bufferLength = 0;
+    return true;
+  }
+
+  bool _fail(const char* error) {
+    if (_state == OTA_RUNNING) _target->abort();
+    LOG->error(F("%s"), error);
+    _error = error;
+    _state = OTA_FAILED;
+    return false;
+  }
+};
+
+#endif
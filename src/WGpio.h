@@ -4,6 +4,8 @@
 #include "WSettings.h"
 #include "WProperty.h"
 #include "IWExpander.h"
+#include "WEdgeBuffer.h"
+#include "WScheduler.h"
 
 #define NO_PIN 0xFF
 #define NO_MODE NO_PIN
@@ -66,7 +68,7 @@ const char* const S_GPIO_TYPE[] PROGMEM = { S_GPIO_TYPE_GROUP, S_GPIO_TYPE_MODE,
                                             S_GPIO_TYPE_BUTTON, S_GPIO_TYPE_SWITCH, S_GPIO_TYPE_HTU21, S_GPIO_TYPE_SHT30, S_GPIO_TYPE_KY013, S_GPIO_TYPE_STATE,
                                             S_GPIO_TYPE_PCF8575 };
 
-class WGpio : public IWJsonable {
+class WGpio : public IWJsonable, public WSchedulable {
  public:
   typedef std::function<void()> THandlerFunction;
   typedef std::function<bool()> TCondition;
@@ -79,6 +81,7 @@ class WGpio : public IWJsonable {
   }
 
   virtual ~WGpio() {
+    if (_edges) delete _edges;
     if (_pin) delete _pin;
   }
 
@@ -95,6 +98,7 @@ class WGpio : public IWJsonable {
       _on = isOn;
       _lastStateChange = millis();
       _updateOn();      
+      wakeUp();
     }
     return this;
   }    
@@ -109,6 +113,9 @@ class WGpio : public IWJsonable {
     }
   }
 
+  // Gpios without polling needs return a later time, see WScheduler
+  virtual unsigned long nextLoop(unsigned long now) { return now; }
+
   WProperty* property() { return _property; }
 
 	WGpio* property(WProperty* property) { 
@@ -146,11 +153,15 @@ class WGpio : public IWJsonable {
       mode(_pin->asByte(), _mode);      
     }
     if (changed) {  
+      if (_edges != nullptr) _useEdges(true, _edgesSecondPin, _edgesMode);
       _onChange();
     }
     return this; 
   }  
 
+  // true, if input edges are recorded by pin interrupt instead of polling
+  bool isUsingInterrupt() { return (_edges != nullptr); }
+
   virtual void registerSettings() {
     _settingsRegistered = true;
     SETTINGS->add(_pin, nullptr); 
@@ -192,6 +203,24 @@ class WGpio : public IWJsonable {
   bool _settingsRegistered = false;
   unsigned long _lastStateChange = 0;
   TCondition _condition;
+  WEdgeBuffer* _edges = nullptr;
+  byte _edgesSecondPin = NO_PIN;
+  int _edgesMode = CHANGE;
+
+  // Records edges of pin (and level of secondPin) by interrupt. Not possible with expanders
+  bool _useEdges(bool useEdges, byte secondPin = NO_PIN, int mode = CHANGE) {
+    if (_edges != nullptr) {
+      delete _edges;
+      _edges = nullptr;
+    }
+    if ((useEdges) && (_expander == nullptr) && (_isInitialized())) {
+      _edgesSecondPin = secondPin;
+      _edgesMode = mode;
+      _edges = new WEdgeBuffer(pin(), secondPin);
+      _edges->attach(mode);
+    }
+    return (_edges != nullptr);
+  }
 
   virtual bool _isInitialized() { return (pin() != NO_PIN); }  
 
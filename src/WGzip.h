@@ -0,0 +1,167 @@
+#ifndef W_GZIP_H
+#define W_GZIP_H
+
+#include <Arduino.h>
+
+// 2^GZIP_HASH_BITS positions of the last 3-byte sequences, 2 bytes each
+#define GZIP_HASH_BITS 10
+#define GZIP_WINDOW 32768
+#define GZIP_MIN_MATCH 3
+#define GZIP_MAX_MATCH 258
+// positions are stored in uint16_t
+#define GZIP_MAX_INPUT 65535
+
+const uint16_t GZIP_LENGTH_BASE[] PROGMEM = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                             35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+const uint8_t GZIP_LENGTH_EXTRA[] PROGMEM = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                             3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+const uint16_t GZIP_DISTANCE_BASE[] PROGMEM = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129,
+                                               193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+const uint8_t GZIP_DISTANCE_EXTRA[] PROGMEM = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+                                               6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+/*
+  Small gzip encoder for content that is compressed once and served often,
+  e.g. cached web pages. Greedy LZ77 with a single hash slot and one deflate
+  block with the fixed Huffman codes: far from zlib's ratio, but it needs only
+  2 KB of work memory and no tables in RAM.
+*/
+class WGzip {
+ public:
+  // Returns a new[] buffer with the gzip member, nullptr if input is too large or memory is short
+  static uint8_t* compress(const uint8_t* data, size_t length, size_t* compressedLength, uint32_t* crc = nullptr) {
+    if (length > GZIP_MAX_INPUT) return nullptr;
+    // fixed codes need at most 9 bits per literal
+    size_t capacity = length + length / 8 + 32;
+    uint8_t* out = new (std::nothrow) uint8_t[capacity];
+    uint16_t* hashes = new (std::nothrow) uint16_t[1 << GZIP_HASH_BITS];
+    if ((out == nullptr) || (hashes == nullptr)) {
+      if (out) delete[] out;
+      if (hashes) delete[] hashes;
+      return nullptr;
+    }
+    // 0xFFFF is never a valid match start, input is shorter
+    memset(hashes, 0xFF, sizeof(uint16_t) << GZIP_HASH_BITS);
+    WGzip gz(out);
+    static const uint8_t header[] = {0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03};
+    for (byte i = 0; i < sizeof(header); i++) gz._byte(header[i]);
+    // last block, fixed Huffman codes
+    gz._bits(1, 1);
+    gz._bits(1, 2);
+    size_t i = 0;
+    while (i < length) {
+      uint16_t matchLength = 0;
+      uint16_t distance = 0;
+      if (i + GZIP_MIN_MATCH <= length) {
+        uint16_t h = _hash(data + i);
+        uint16_t candidate = hashes[h];
+        hashes[h] = i;
+        if ((candidate != 0xFFFF) && (i - candidate <= GZIP_WINDOW)) {
+          size_t max = min((size_t)GZIP_MAX_MATCH, length - i);
+          while ((matchLength < max) && (data[candidate + matchLength] == data[i + matchLength])) matchLength++;
+          distance = i - candidate;
+        }
+      }
+      if (matchLength >= GZIP_MIN_MATCH) {
+        gz._match(matchLength, distance);
+        // index the skipped positions too, cheap and improves following matches
+        for (size_t j = i + 1; (j < i + matchLength) && (j + GZIP_MIN_MATCH <= length); j++) {
+          hashes[_hash(data + j)] = j;
+        }
+        i += matchLength;
+      } else {
+        gz._literal(data[i]);
+        i++;
+      }
+    }
+    // end of block
+    gz._literal(256);
+    gz._flush();
+    uint32_t c = crc32(data, length);
+    gz._uint32(c);
+    gz._uint32(length);
+    delete[] hashes;
+    if (crc) *crc = c;
+    *compressedLength = gz._pos;
+    return out;
+  }
+
+  static uint32_t crc32(const uint8_t* data, size_t length) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < length; i++) {
+      crc ^= data[i];
+      for (byte b = 0; b < 8; b++) crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+    return ~crc;
+  }
+
+ private:
+  uint8_t* _out;
+  size_t _pos = 0;
+  uint32_t _bitBuffer = 0;
+  byte _bitCount = 0;
+
+  WGzip(uint8_t* out) { _out = out; }
+
+  static uint16_t _hash(const uint8_t* p) {
+    return (uint32_t)(((uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2]) * 2654435761UL) >> (32 - GZIP_HASH_BITS);
+  }
+
+  void _byte(uint8_t b) { _out[_pos++] = b; }
+
+  void _uint32(uint32_t v) {
+    for (byte i = 0; i < 4; i++) _byte(v >> (8 * i));
+  }
+
+  // deflate packs bits starting with the least significant
+  void _bits(uint32_t value, byte count) {
+    _bitBuffer |= value << _bitCount;
+    _bitCount += count;
+    while (_bitCount >= 8) {
+      _byte(_bitBuffer);
+      _bitBuffer >>= 8;
+      _bitCount -= 8;
+    }
+  }
+
+  void _flush() {
+    if (_bitCount > 0) _byte(_bitBuffer);
+    _bitBuffer = 0;
+    _bitCount = 0;
+  }
+
+  // Huffman codes are stored most significant bit first
+  void _code(uint16_t code, byte count) {
+    uint16_t reversed = 0;
+    for (byte i = 0; i < count; i++) {
+      reversed = (reversed << 1) | (code & 1);
+      code >>= 1;
+    }
+    _bits(reversed, count);
+  }
+
+  void _literal(uint16_t symbol) {
+    if (symbol < 144) {
+      _code(0x30 + symbol, 8);
+    } else if (symbol < 256) {
+      _code(0x190 + symbol - 144, 9);
+    } else if (symbol < 280) {
+      _code(symbol - 256, 7);
+    } else {
+      _code(0xC0 + symbol - 280, 8);
+    }
+  }
+
+  void _match(uint16_t length, uint16_t distance) {
+    byte i = 28;
+    while (pgm_read_word(&GZIP_LENGTH_BASE[i]) > length) i--;
+    _literal(257 + i);
+    _bits(length - pgm_read_word(&GZIP_LENGTH_BASE[i]), pgm_read_byte(&GZIP_LENGTH_EXTRA[i]));
+    i = 29;
+    while (pgm_read_word(&GZIP_DISTANCE_BASE[i]) > distance) i--;
+    _code(i, 5);
+    _bits(distance - pgm_read_word(&GZIP_DISTANCE_BASE[i]), pgm_read_byte(&GZIP_DISTANCE_EXTRA[i]));
+  }
+};
+
+#endif
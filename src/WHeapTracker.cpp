@@ -0,0 +1,28 @@
+/*
+  Storage of WHeapTracker and the replaced global operator new/delete.
+  Compiled only with build flag -DW_HEAP_TRACKING, in this one translation unit.
+*/
+
+#ifdef W_HEAP_TRACKING
+
+#include "WHeapTracker.h"
+
+WHeapStats WHeapTracker::_stats[HEAP_TAG_COUNT] = {};
+uint32_t WHeapTracker::_allocations = 0;
+#ifdef ARDUINO_ARCH_ESP32
+thread_local byte WHeapTracker::_tag = HEAP_OTHER;
+portMUX_TYPE WHeapTracker::_mux = portMUX_INITIALIZER_UNLOCKED;
+#else
+byte WHeapTracker::_tag = HEAP_OTHER;
+#endif
+
+void* operator new(size_t size) { return WHeapTracker::allocate(size); }
+void* operator new[](size_t size) { return WHeapTracker::allocate(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return WHeapTracker::allocate(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return WHeapTracker::allocate(size); }
+void operator delete(void* p) noexcept { WHeapTracker::release(p); }
+void operator delete[](void* p) noexcept { WHeapTracker::release(p); }
+void operator delete(void* p, size_t size) noexcept { WHeapTracker::release(p); }
+void operator delete[](void* p, size_t size) noexcept { WHeapTracker::release(p); }
+
+#endif
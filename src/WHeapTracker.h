@@ -0,0 +1,159 @@
+#ifndef W_HEAP_TRACKER_H
+#define W_HEAP_TRACKER_H
+
+/*
+  Heap telemetry, enabled with build flag -DW_HEAP_TRACKING. Only with the
+  flag, WHeapTracker.cpp replaces the global operator new/delete; the header
+  itself defines nothing global. Every allocation is charged to the tag of
+  the innermost HEAP_TAG scope of the allocating task; current/peak bytes and
+  counts are kept per tag. allocations() only grows, so a test can compare it
+  before and after a steady state loop to detect any allocation.
+  Without the flag, HEAP_TAG compiles to nothing.
+*/
+
+#ifdef W_HEAP_TRACKING
+
+#include <Arduino.h>
+
+#include <new>
+
+#define HEAP_PUBLISH_INTERVAL 60000
+
+enum WHeapTag {
+  HEAP_OTHER,
+  HEAP_JSON,
+  HEAP_LIST,
+  HEAP_WEB,
+  HEAP_MQTT,
+  HEAP_SETTINGS,
+  HEAP_TAG_COUNT
+};
+
+const char S_HEAP_OTHER[] PROGMEM = "other";
+const char S_HEAP_JSON[] PROGMEM = "json";
+const char S_HEAP_LIST[] PROGMEM = "list";
+const char S_HEAP_WEB[] PROGMEM = "web";
+const char S_HEAP_MQTT[] PROGMEM = "mqtt";
+const char S_HEAP_SETTINGS[] PROGMEM = "settings";
+const char* const S_HEAP_TAG[] PROGMEM = {S_HEAP_OTHER, S_HEAP_JSON, S_HEAP_LIST, S_HEAP_WEB, S_HEAP_MQTT, S_HEAP_SETTINGS};
+
+struct WHeapStats {
+  uint32_t bytes;
+  uint32_t peakBytes;
+  uint32_t count;
+  uint32_t peakCount;
+};
+
+// Stored in front of every tracked block, keeps the block 8 byte aligned
+struct WHeapHeader {
+  uint32_t size;
+  uint32_t tag;
+};
+
+class WHeapTracker {
+ public:
+  static WHeapStats* stats(byte tag) { return &_stats[tag]; }
+
+  static uint32_t allocations() { return _allocations; }
+
+  static byte tag() { return _tag; }
+
+  static void tag(byte tag) { _tag = tag; }
+
+  // copy of the tag name (in flash) to buffer
+  static const char* name(byte tag, char* buffer, size_t size) {
+    strncpy_P(buffer, (const char*)pgm_read_ptr(&S_HEAP_TAG[tag]), size);
+    buffer[size - 1] = '\0';
+    return buffer;
+  }
+
+  static uint32_t largestFreeBlock() {
+#ifdef ARDUINO_ARCH_ESP8266
+    return ESP.getMaxFreeBlockSize();
+#elif ARDUINO_ARCH_ESP32
+    return ESP.getMaxAllocHeap();
+#else
+    return 0;
+#endif
+  }
+
+  static void* allocate(size_t size) {
+    WHeapHeader* header = (WHeapHeader*)malloc(sizeof(WHeapHeader) + size);
+    if (header == nullptr) return nullptr;
+    header->size = size;
+    header->tag = _tag;
+    _lock();
+    WHeapStats* s = &_stats[header->tag];
+    s->bytes += size;
+    s->count++;
+    if (s->bytes > s->peakBytes) s->peakBytes = s->bytes;
+    if (s->count > s->peakCount) s->peakCount = s->count;
+    _allocations++;
+    _unlock();
+    return header + 1;
+  }
+
+  static void release(void* p) {
+    if (p == nullptr) return;
+    WHeapHeader* header = ((WHeapHeader*)p) - 1;
+    _lock();
+    WHeapStats* s = &_stats[header->tag];
+    s->bytes -= header->size;
+    s->count--;
+    _unlock();
+    free(header);
+  }
+
+  // peaks start again at the current values
+  static void resetPeaks() {
+    _lock();
+    for (byte i = 0; i < HEAP_TAG_COUNT; i++) {
+      _stats[i].peakBytes = _stats[i].bytes;
+      _stats[i].peakCount = _stats[i].count;
+    }
+    _unlock();
+  }
+
+ private:
+  static WHeapStats _stats[HEAP_TAG_COUNT];
+  static uint32_t _allocations;
+#ifdef ARDUINO_ARCH_ESP32
+  // per task, the async web server allocates from its own
+  static thread_local byte _tag;
+#else
+  static byte _tag;
+#endif
+#ifdef ARDUINO_ARCH_ESP32
+  // the async web server allocates from its own task
+  static portMUX_TYPE _mux;
+  static void _lock() { portENTER_CRITICAL(&_mux); }
+  static void _unlock() { portEXIT_CRITICAL(&_mux); }
+#else
+  static void _lock() {}
+  static void _unlock() {}
+#endif
+};
+
+// Charges all allocations until end of the enclosing scope to tag
+class WHeapScope {
+ public:
+  WHeapScope(byte tag) {
+    _previous = WHeapTracker::tag();
+    WHeapTracker::tag(tag);
+  }
+
+  ~WHeapScope() { WHeapTracker::tag(_previous); }
+
+ private:
+  byte _previous;
+};
+
+#define HEAP_TAG(tag) WHeapScope _heapScope(tag)
+
+#else
+
+#define HEAP_TAG(tag)
+
+#endif
+
+#endif
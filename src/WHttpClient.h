@@ -1,35 +1,566 @@
 #ifndef W_HTTP_CLIENT
 #define W_HTTP_CLIENT
 
+#include <Arduino.h>
+#ifdef ARDUINO_ARCH_ESP8266
+#include <ESPAsyncTCP.h>
+#elif ARDUINO_ARCH_ESP32
 #include <AsyncTCP.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#endif
 
+#include "WList.h"
+#include "WLog.h"
+
+#define HTTP_MAX_CONNECTIONS 2
+#define HTTP_QUEUE_SIZE 8
+// without any data from the server, a request fails
+#define HTTP_TIMEOUT 10000
+// unused keep-alive connections are closed after
+#define HTTP_IDLE_TIMEOUT 15000
+// longer status or header lines are truncated
+#define HTTP_LINE_LENGTH 128
+#define HTTP_DEFAULT_PORT 80
+// negative status at completion
+#define HTTP_ERROR_CONNECT -1
+#define HTTP_ERROR_TIMEOUT -2
+#define HTTP_ERROR_PARSE -3
+#define HTTP_ERROR_DISCONNECTED -4
+#define HTTP_ERROR_QUEUE_FULL -5
+
+/*
+  Incremental HTTP/1.1 response parser. Bytes are fed as they arrive, the
+  body is passed on chunk by chunk, never buffered. Handles content-length,
+  chunked and close-delimited bodies; interim 1xx responses are skipped.
+*/
+class WHttpResponseParser {
+ public:
+  typedef std::function<void(const char* name, const char* value)> TOnHeader;
+  typedef std::function<void(const uint8_t* data, size_t length)> TOnBody;
+
+  void reset(bool head, TOnHeader onHeader, TOnBody onBody) {
+    _head = head;
+    _onHeader = onHeader;
+    _onBody = onBody;
+    _reset();
+  }
+
+  // false, if the response is malformed
+  bool feed(const uint8_t* data, size_t length) {
+    size_t i = 0;
+    while ((i < length) && (_state != PARSE_DONE) && (_state != PARSE_ERROR)) {
+      if ((_state == PARSE_BODY) || (_state == PARSE_CHUNK_DATA)) {
+        size_t l = length - i;
+        if ((_remaining >= 0) && ((size_t)_remaining < l)) l = _remaining;
+        if (_onBody) _onBody(data + i, l);
+        i += l;
+        if (_remaining >= 0) {
+          _remaining -= l;
+          if (_remaining == 0) _state = (_state == PARSE_BODY ? PARSE_DONE : PARSE_CHUNK_END);
+        }
+      } else {
+        char c = data[i++];
+        if (c == '\n') {
+          _line[_lineLength] = '\0';
+          _lineLength = 0;
+          _parseLine();
+        } else if ((c != '\r') && (_lineLength < HTTP_LINE_LENGTH - 1)) {
+          _line[_lineLength++] = c;
+        }
+      }
+    }
+    return (_state != PARSE_ERROR);
+  }
+
+  // At disconnect, completes a body without length
+  bool finish() {
+    if ((_state == PARSE_BODY) && (_remaining < 0)) _state = PARSE_DONE;
+    return (_state == PARSE_DONE);
+  }
+
+  bool done() { return (_state == PARSE_DONE); }
+
+  // true, if any byte of the response was received
+  bool started() { return _started; }
+
+  int status() { return _status; }
+
+  // The connection can take the next request
+  bool keepAlive() { return ((_state == PARSE_DONE) && (_keepAlive)); }
+
+ private:
+  enum WParseState { PARSE_STATUS, PARSE_HEADERS, PARSE_BODY, PARSE_CHUNK_SIZE, PARSE_CHUNK_DATA, PARSE_CHUNK_END, PARSE_TRAILER, PARSE_DONE, PARSE_ERROR };
+  WParseState _state;
+  bool _head = false;
+  bool _started;
+  bool _keepAlive;
+  bool _chunked;
+  int _status;
+  // bytes left of body or chunk, -1 until close
+  long _remaining;
+  char _line[HTTP_LINE_LENGTH];
+  uint16_t _lineLength;
+  TOnHeader _onHeader;
+  TOnBody _onBody;
+
+  void _reset() {
+    _state = PARSE_STATUS;
+    _started = false;
+    _keepAlive = true;
+    _chunked = false;
+    _status = 0;
+    _remaining = -1;
+    _lineLength = 0;
+  }
+
+  void _parseLine() {
+    switch (_state) {
+      case PARSE_STATUS:
+        // "HTTP/1.1 200 OK"
+        if (_line[0] == '\0') return;
+        _started = true;
+        if ((strncmp(_line, "HTTP/1.", 7) != 0) || (strlen(_line) < 12)) {
+          _state = PARSE_ERROR;
+          return;
+        }
+        _keepAlive = (_line[7] != '0');
+        _status = atoi(_line + 9);
+        _state = (_status >= 100 ? PARSE_HEADERS : PARSE_ERROR);
+        break;
+      case PARSE_HEADERS:
+        if (_line[0] == '\0') {
+          _headersDone();
+        } else {
+          _parseHeader();
+        }
+        break;
+      case PARSE_CHUNK_SIZE: {
+        char* end;
+        // extensions after ';' are ignored
+        _remaining = strtol(_line, &end, 16);
+        if ((end == _line) || (_remaining < 0)) {
+          _state = PARSE_ERROR;
+        } else {
+          _state = (_remaining == 0 ? PARSE_TRAILER : PARSE_CHUNK_DATA);
+        }
+        break;
+      }
+      case PARSE_CHUNK_END:
+        _state = (_line[0] == '\0' ? PARSE_CHUNK_SIZE : PARSE_ERROR);
+        break;
+      case PARSE_TRAILER:
+        if (_line[0] == '\0') _state = PARSE_DONE;
+        break;
+      default:
+        break;
+    }
+  }
+
+  void _parseHeader() {
+    char* value = strchr(_line, ':');
+    if (value == nullptr) return;
+    *value++ = '\0';
+    while (*value == ' ') value++;
+    if (strcasecmp(_line, "Content-Length") == 0) {
+      _remaining = atol(value);
+    } else if (strcasecmp(_line, "Transfer-Encoding") == 0) {
+      _chunked = (strcasecmp(value, "chunked") == 0);
+    } else if (strcasecmp(_line, "Connection") == 0) {
+      if (strcasecmp(value, "close") == 0) {
+        _keepAlive = false;
+      } else if (strcasecmp(value, "keep-alive") == 0) {
+        _keepAlive = true;
+      }
+    }
+    if ((_onHeader) && (_status >= 200)) _onHeader(_line, value);
+  }
+
+  void _headersDone() {
+    if (_status < 200) {
+      // 100 Continue, the real response follows
+      bool keepAlive = _keepAlive;
+      _reset();
+      _keepAlive = keepAlive;
+      _started = true;
+    } else if ((_head) || (_status == 204) || (_status == 304)) {
+      _state = PARSE_DONE;
+    } else if (_chunked) {
+      _state = PARSE_CHUNK_SIZE;
+    } else if (_remaining == 0) {
+      _state = PARSE_DONE;
+    } else {
+      // without length, the body ends with the connection
+      if (_remaining < 0) _keepAlive = false;
+      _state = PARSE_BODY;
+    }
+  }
+};
+
+struct WHttpRequest {
+  WHttpRequest(const char* method, const char* host, uint16_t port, const char* path, const char* contentType, const uint8_t* body, size_t length, bool keepAlive) {
+    this->host = new char[strlen(host) + 1];
+    strcpy(this->host, host);
+    this->port = port;
+    this->head = (strcmp(method, "HEAD") == 0);
+    const char* connection = (keepAlive ? "keep-alive" : "close");
+    size_t headerLength = snprintf(nullptr, 0, "%s %s HTTP/1.1\r\nHost: %s\r\nConnection: %s\r\n", method, path, host, connection);
+    if (contentType != nullptr) headerLength += snprintf(nullptr, 0, "Content-Type: %s\r\nContent-Length: %u\r\n", contentType, (unsigned int)length);
+    this->length = headerLength + 2 + length;
+    this->data = new char[this->length + 1];
+    int l = sprintf(this->data, "%s %s HTTP/1.1\r\nHost: %s\r\nConnection: %s\r\n", method, path, host, connection);
+    if (contentType != nullptr) l += sprintf(this->data + l, "Content-Type: %s\r\nContent-Length: %u\r\n", contentType, (unsigned int)length);
+    l += sprintf(this->data + l, "\r\n");
+    if (length > 0) memcpy(this->data + l, body, length);
+  }
+
+  virtual ~WHttpRequest() {
+    delete[] host;
+    delete[] data;
+  }
+
+  char* host;
+  uint16_t port;
+  bool head;
+  // request line, headers and body as sent
+  char* data;
+  size_t length;
+  size_t sent = 0;
+  // a request on a reused connection is retried once, if the server closed it meanwhile
+  bool retried = false;
+  WHttpResponseParser::TOnHeader onHeader;
+  WHttpResponseParser::TOnBody onBody;
+  std::function<void(int status)> onComplete;
+};
+
+enum WHttpConnectionState { HTTP_CONNECTION_CLOSED, HTTP_CONNECTION_CONNECTING, HTTP_CONNECTION_BUSY, HTTP_CONNECTION_IDLE };
+
+struct WHttpConnection {
+  AsyncClient* client = nullptr;
+  WHttpConnectionState state = HTTP_CONNECTION_CLOSED;
+  char* host = nullptr;
+  uint16_t port = 0;
+  // last connect, data or completion
+  unsigned long lastActivity = 0;
+  bool reused = false;
+  // callbacks of client running, it must not be deleted meanwhile
+  byte callbacks = 0;
+  WHttpRequest* request = nullptr;
+  WHttpResponseParser parser;
+};
+
+/*
+  Asynchronous HTTP/1.1 client. Requests are queued (at most HTTP_QUEUE_SIZE)
+  and run on up to maxConnections connections at a time. Connections are
+  kept alive after a response and reused for the next request to the same
+  host. Response headers and body are passed to the callbacks as they
+  arrive, onComplete gets the status or a negative HTTP_ERROR_*.
+  Callbacks run in the context of the tcp stack, on ESP32 that's the
+  async_tcp task; a recursive lock keeps it and the loop apart. loop()
+  handles timeouts and closes idle connections. Closed connections are
+  taken by the next request, also without loop().
+*/
+class WHttpClient {
+ public:
+  typedef WHttpResponseParser::TOnHeader TOnHeader;
+  typedef WHttpResponseParser::TOnBody TOnBody;
+  typedef std::function<void(int status)> TOnComplete;
+
+  WHttpClient(byte maxConnections = HTTP_MAX_CONNECTIONS) {
+    _maxConnections = maxConnections;
+    _connections = new WHttpConnection[maxConnections];
+    _queue = new WList<WHttpRequest>();
+#ifdef ARDUINO_ARCH_ESP32
+    _mutex = xSemaphoreCreateRecursiveMutex();
+#endif
+  }
+
+  ~WHttpClient() {
+    WHttpGuard guard(this);
+    for (byte i = 0; i < _maxConnections; i++) _close(&_connections[i], HTTP_ERROR_DISCONNECTED);
+    // queued requests fail too, their callbacks may own memory
+    while (!_queue->empty()) {
+      WHttpRequest* request = _queue->get(0);
+      _queue->remove(0);
+      if (request->onComplete) request->onComplete(HTTP_ERROR_DISCONNECTED);
+      delete request;
+    }
+    for (byte i = 0; i < _maxConnections; i++) {
+      if (_connections[i].client) delete _connections[i].client;
+      if (_connections[i].host) delete[] _connections[i].host;
+    }
+    delete[] _connections;
+    delete _queue;
+#ifdef ARDUINO_ARCH_ESP32
+    guard.release();
+    vSemaphoreDelete(_mutex);
+#endif
+  }
+
+  // Without keep-alive, every request gets a new connection
+  void keepAlive(bool keepAlive) { _keepAlive = keepAlive; }
+
+  void timeout(unsigned long timeout) { _timeout = timeout; }
+
+  bool get(const char* host, uint16_t port, const char* path, TOnBody onBody, TOnComplete onComplete, TOnHeader onHeader = nullptr) {
+    return request("GET", host, port, path, nullptr, nullptr, 0, onBody, onComplete, onHeader);
+  }
+
+  // false, if the queue is full
+  bool request(const char* method, const char* host, uint16_t port, const char* path, const char* contentType, const uint8_t* body, size_t length,
+               TOnBody onBody, TOnComplete onComplete, TOnHeader onHeader = nullptr) {
+    WHttpGuard guard(this);
+    if (_queue->size() >= HTTP_QUEUE_SIZE) {
+      LOG->debug(F("HTTP queue full, request to '%s' dropped"), host);
+      return false;
+    }
+    WHttpRequest* request = new WHttpRequest(method, host, port, path, contentType, body, length, _keepAlive);
+    request->onHeader = onHeader;
+    request->onBody = onBody;
+    request->onComplete = onComplete;
+    _queue->add(request);
+    _dispatch();
+    return true;
+  }
+
+  void loop(unsigned long now) {
+    WHttpGuard guard(this);
+    for (byte i = 0; i < _maxConnections; i++) {
+      WHttpConnection* c = &_connections[i];
+      if (((c->state == HTTP_CONNECTION_CONNECTING) || (c->state == HTTP_CONNECTION_BUSY)) && (now - c->lastActivity > _timeout)) {
+        LOG->debug(F("HTTP request to '%s' timed out"), c->host);
+        _close(c, HTTP_ERROR_TIMEOUT);
+      } else if ((c->state == HTTP_CONNECTION_IDLE) && (now - c->lastActivity > HTTP_IDLE_TIMEOUT)) {
+        _close(c, 0);
+      }
+      if (c->state == HTTP_CONNECTION_CLOSED) _release(c);
+    }
+    _dispatch();
+  }
+
+  size_t pending() {
+    WHttpGuard guard(this);
+    return _queue->size();
+  }
+
+  // Number of connects so far, to see how well connections are reused
+  uint32_t connects() { return _connects; }
+
+ private:
+  WHttpConnection* _connections;
+  byte _maxConnections;
+  WList<WHttpRequest>* _queue;
+  bool _keepAlive = true;
+  unsigned long _timeout = HTTP_TIMEOUT;
+  uint32_t _connects = 0;
+#ifdef ARDUINO_ARCH_ESP32
+  SemaphoreHandle_t _mutex;
+#endif
+
+  // Held by requests, loop() and the tcp callbacks of a connection
+  class WHttpGuard {
+   public:
+    WHttpGuard(WHttpClient* client, WHttpConnection* c = nullptr) {
+      _client = client;
+      _c = c;
+#ifdef ARDUINO_ARCH_ESP32
+      xSemaphoreTakeRecursive(_client->_mutex, portMAX_DELAY);
+#endif
+      if (_c) _c->callbacks++;
+    }
+
+    ~WHttpGuard() { release(); }
+
+    void release() {
+      if (_client == nullptr) return;
+      if (_c) _c->callbacks--;
+#ifdef ARDUINO_ARCH_ESP32
+      xSemaphoreGiveRecursive(_client->_mutex);
+#endif
+      _client = nullptr;
+    }
+
+   private:
+    WHttpClient* _client;
+    WHttpConnection* _c;
+  };
+
+  // Deletes the client of a closed connection, not within its own callbacks
+  bool _release(WHttpConnection* c) {
+    if (c->callbacks > 0) return false;
+    if (c->client) delete c->client;
+    c->client = nullptr;
+    return true;
+  }
+
+  // Starts queued requests on free connections, an idle one to the same host first
+  void _dispatch() {
+    while (!_queue->empty()) {
+      WHttpRequest* request = _queue->get(0);
+      WHttpConnection* free = nullptr;
+      for (byte i = 0; i < _maxConnections; i++) {
+        WHttpConnection* c = &_connections[i];
+        if ((c->state == HTTP_CONNECTION_IDLE) && (c->port == request->port) && (strcmp(c->host, request->host) == 0)) {
+          free = c;
+          break;
+        } else if ((c->state == HTTP_CONNECTION_CLOSED) && (c->callbacks == 0) && (free == nullptr)) {
+          free = c;
+        }
+      }
+      if (free == nullptr) {
+        // an idle connection to another host makes room
+        for (byte i = 0; (i < _maxConnections) && (free == nullptr); i++) {
+          if ((_connections[i].state == HTTP_CONNECTION_IDLE) && (_connections[i].callbacks == 0)) free = &_connections[i];
+        }
+        if (free == nullptr) return;
+        _close(free, 0);
+      }
+      if (free->state == HTTP_CONNECTION_CLOSED) _release(free);
+      _queue->remove(0);
+      _start(free, request);
+    }
+  }
+
+  void _start(WHttpConnection* c, WHttpRequest* request) {
+    c->request = request;
+    c->parser.reset(request->head, request->onHeader, request->onBody);
+    c->lastActivity = millis();
+    request->sent = 0;
+    if (c->state == HTTP_CONNECTION_IDLE) {
+      c->state = HTTP_CONNECTION_BUSY;
+      c->reused = true;
+      _send(c);
+      return;
+    }
+    if (c->host) delete[] c->host;
+    c->host = new char[strlen(request->host) + 1];
+    strcpy(c->host, request->host);
+    c->port = request->port;
+    c->reused = false;
+    c->state = HTTP_CONNECTION_CONNECTING;
+    c->client = new AsyncClient();
+    _bind(c);
+    _connects++;
+    if (!c->client->connect(c->host, c->port)) _close(c, HTTP_ERROR_CONNECT);
+  }
+
+  void _bind(WHttpConnection* c) {
+    c->client->onConnect([this, c](void* arg, AsyncClient* client) {
+      WHttpGuard guard(this, c);
+      c->state = HTTP_CONNECTION_BUSY;
+      c->lastActivity = millis();
+      _send(c);
+    }, nullptr);
+    c->client->onAck([this, c](void* arg, AsyncClient* client, size_t length, uint32_t time) {
+      WHttpGuard guard(this, c);
+      c->lastActivity = millis();
+      _send(c);
+    }, nullptr);
+    c->client->onData([this, c](void* arg, AsyncClient* client, void* data, size_t length) {
+      WHttpGuard guard(this, c);
+      c->lastActivity = millis();
+      if (c->request == nullptr) return;
+      if (!c->parser.feed((const uint8_t*)data, length)) {
+        _close(c, HTTP_ERROR_PARSE);
+      } else if (c->parser.done()) {
+        _complete(c);
+      }
+    }, nullptr);
+    c->client->onError([this, c](void* arg, AsyncClient* client, int8_t error) {
+      WHttpGuard guard(this, c);
+      LOG->debug(F("HTTP connection to '%s' error %d"), c->host, error);
+      _close(c, HTTP_ERROR_CONNECT);
+    }, nullptr);
+    c->client->onDisconnect([this, c](void* arg, AsyncClient* client) {
+      WHttpGuard guard(this, c);
+      _disconnected(c);
+    }, nullptr);
+  }
+
+  // As much of the request as the tcp buffer takes, the rest after the next ack
+  void _send(WHttpConnection* c) {
+    WHttpRequest* request = c->request;
+    if ((request == nullptr) || (c->state != HTTP_CONNECTION_BUSY) || (request->sent >= request->length)) return;
+    size_t l = min(c->client->space(), request->length - request->sent);
+    if (l == 0) return;
+    l = c->client->add(request->data + request->sent, l);
+    request->sent += l;
+    c->client->send();
+  }
+
+  void _complete(WHttpConnection* c) {
+    WHttpRequest* request = c->request;
+    c->request = nullptr;
+    c->lastActivity = millis();
+    bool keepAlive = ((_keepAlive) && (c->parser.keepAlive()));
+    if (keepAlive) {
+      c->state = HTTP_CONNECTION_IDLE;
+    } else {
+      _close(c, 0);
+    }
+    if (request->onComplete) request->onComplete(c->parser.status());
+    delete request;
+  }
+
+  void _disconnected(WHttpConnection* c) {
+    WHttpConnectionState state = c->state;
+    c->state = HTTP_CONNECTION_CLOSED;
+    WHttpRequest* request = c->request;
+    if (request == nullptr) return;
+    if (c->parser.finish()) {
+      _complete(c);
+    } else if ((state == HTTP_CONNECTION_BUSY) && (c->reused) && (!c->parser.started()) && (!request->retried)) {
+      // the server closed the idle connection while the request was sent
+      c->request = nullptr;
+      request->retried = true;
+      _queue->insert(request, 0);
+    } else {
+      _close(c, HTTP_ERROR_DISCONNECTED);
+    }
+  }
+
+  // Closes the connection and fails its request with error (if not 0)
+  void _close(WHttpConnection* c, int error) {
+    WHttpRequest* request = c->request;
+    c->request = nullptr;
+    c->state = HTTP_CONNECTION_CLOSED;
+    if ((c->client) && (c->client->connected())) c->client->close(true);
+    if (request) {
+      if (request->onComplete) request->onComplete(error != 0 ? error : HTTP_ERROR_DISCONNECTED);
+      delete request;
+    }
+  }
+};
+
+/*
+  One shot GET with the whole body as String, kept for compatibility.
+  Connections of all calls are shared and kept alive. Call loop() from the
+  main loop, without it requests never time out and idle connections stay
+  open until the next request needs them.
+*/
 class SimpleAsyncHTTP {
-public:
-    void GET(const char* host, const char* path, std::function<void(int, String)> callback) {
-        _callback = callback;
-        _client = new AsyncClient();
-        _client->onData([this](void* arg, AsyncClient* c, void* data, size_t len) {
-            // Hier kommt die Antwort an. In einer echten Implementierung
-            // müsste der HTTP-Header geparst werden, um das Ende der Antwort zu erkennen.
-            String response = String((char*)data).substring(0, len);
-            _callback(200, response); // Rückruf mit den Rohdaten
-            c->close();
-        }, nullptr);
-        
-        _client->onDisconnect([](void* arg, AsyncClient* c) {
-            delete c;
-        }, nullptr);
-        
-        _client->connect(host, 80);
-        String request = "GET " + String(path) + " HTTP/1.1\r\n"
-                        "Host: " + String(host) + "\r\n"
-                        "Connection: close\r\n\r\n";
-        _client->write(request.c_str());
-    }
-
-private:
-    AsyncClient* _client;
-    std::function<void(int, String)> _callback;
+ public:
+  // callback gets HTTP_ERROR_QUEUE_FULL at once, if the request can't be queued
+  void GET(const char* host, const char* path, std::function<void(int, String)> callback) {
+    String* body = new String();
+    bool queued = _client.get(host, HTTP_DEFAULT_PORT, path, [body](const uint8_t* data, size_t length) {
+                                body->reserve(body->length() + length);
+                                for (size_t i = 0; i < length; i++) *body += (char)data[i];
+                              },
+                              [body, callback](int status) {
+                                callback(status, *body);
+                                delete body;
+                              });
+    if (!queued) {
+      delete body;
+      callback(HTTP_ERROR_QUEUE_FULL, String());
+    }
+  }
+
+  void loop(unsigned long now) { _client.loop(now); }
+
+ private:
+  WHttpClient _client;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -3,30 +3,43 @@
 
 #include <Wire.h>
 #include "WGpio.h"
+#include "WI2CBus.h"
 
 class WI2C: public WGpio {
 public:
 	WI2C(WGpioType gpioType, byte address, int sda, int scl, int interrupt, TwoWire* i2cPort = &Wire)
-			: WGpio(gpioType, interrupt, INPUT_PULLUP) {
-		_i2cPort = i2cPort;
+			: WGpio(gpioType, interrupt, INPUT_PULLUP), _device(address) {
+		_bus = WI2CBus::of(i2cPort);
 		_address = address;
 		_sda = sda;
 		_scl = scl;
-		if (this->isInitialized()) {
-			_i2cPort->begin(_sda, _scl);
+		// no bus, if there are more ports than I2C_MAX_BUSES; transactions fail with I2C_ERROR_NO_BUS
+		if ((_bus != nullptr) && (this->isInitialized())) {
+			_bus->begin(_sda, _scl);
 		}
 	}
 
+	virtual ~WI2C() {
+		if (_bus != nullptr) _bus->cancel(&_device);
+	}
+
 	byte address() {
 		return _address;
 	}
 
+	// Clock and transaction, error and latency counters
+	WI2CDevice* i2cDevice() {
+		return &_device;
+	}
+
 	virtual void loop(unsigned long now) {
 		WGpio::loop(now);
+		if (_bus != nullptr) _bus->loop(now);
 	}
 
 protected:
-	TwoWire* _i2cPort;
+	WI2CBus* _bus;
+	WI2CDevice _device;
 	byte _address;
 	int _sda;
 	int _scl;	
@@ -35,6 +48,26 @@ protected:
 		return ((_sda != NO_PIN) && (_scl != NO_PIN));
 	}
 
+	bool _write(const uint8_t* data, byte length, TI2CCallback callback = nullptr, unsigned long holdMillis = 0) {
+		if (_bus == nullptr) return false;
+		return _bus->write(&_device, data, length, callback, holdMillis);
+	}
+
+	bool _read(byte length, TI2CCallback callback) {
+		if (_bus == nullptr) return false;
+		return _bus->writeRead(&_device, nullptr, 0, length, callback);
+	}
+
+	bool _writeRead(const uint8_t* data, byte writeLength, byte readLength, TI2CCallback callback) {
+		if (_bus == nullptr) return false;
+		return _bus->writeRead(&_device, data, writeLength, readLength, callback);
+	}
+
+	byte _transfer(const uint8_t* data, byte writeLength, uint8_t* result = nullptr, byte readLength = 0) {
+		if (_bus == nullptr) return I2C_ERROR_NO_BUS;
+		return _bus->transfer(&_device, data, writeLength, result, readLength);
+	}
+
 private:
 	
 };
@@ -0,0 +1,262 @@
+#ifndef W_I2C_BUS_H
+#define W_I2C_BUS_H
+
+#include <Arduino.h>
+#include <Wire.h>
+
+#include "WLog.h"
+
+#define I2C_MAX_BUSES 2
+#define I2C_QUEUE_SIZE 8
+// written and read bytes of a transaction, the Wire buffer of the ESP8266 holds 32
+#define I2C_DATA_SIZE 32
+#define I2C_CLOCK_DEFAULT 100000
+// a transaction blocks for its transfer only, a loop runs at most this many
+#define I2C_TRANSACTIONS_PER_LOOP 2
+
+// Results, 1..5 are the codes of Wire.endTransmission()
+#define I2C_OK 0
+#define I2C_ERROR_READ 6
+#define I2C_ERROR_BUSY 7
+#define I2C_ERROR_SIZE 8
+#define I2C_ERROR_NO_BUS 9
+
+typedef std::function<void(byte error, const uint8_t* data, byte length)> TI2CCallback;
+
+class WI2CBus;
+WI2CBus* I2C_BUSES[I2C_MAX_BUSES];
+
+/*
+  A chip on a bus with its own clock. Counts transactions, errors and the
+  latency from queueing to completion in us.
+*/
+class WI2CDevice {
+ public:
+  WI2CDevice(byte address, uint32_t clock = I2C_CLOCK_DEFAULT) {
+    _address = address;
+    _clock = clock;
+  }
+
+  byte address() { return _address; }
+
+  uint32_t clock() { return _clock; }
+
+  // Bus clock for the transactions of this device, other devices keep theirs
+  void clock(uint32_t clock) { _clock = clock; }
+
+  // false while the device needs time after a transaction, e.g. for an eeprom write
+  bool isReady(unsigned long now) {
+    if ((_holding) && ((long)(now - _readyAt) >= 0)) _holding = false;
+    return !_holding;
+  }
+
+  uint32_t transactions() { return _transactions; }
+
+  uint32_t errors() { return _errors; }
+
+  byte lastError() { return _lastError; }
+
+  uint32_t latencyMax() { return _latencyMax; }
+
+  uint32_t latencyAverage() { return (_transactions > 0 ? _latencyTotal / _transactions : 0); }
+
+ private:
+  friend class WI2CBus;
+  byte _address;
+  uint32_t _clock;
+  bool _holding = false;
+  unsigned long _readyAt = 0;
+  uint32_t _transactions = 0;
+  uint32_t _errors = 0;
+  byte _lastError = I2C_OK;
+  uint32_t _latencyMax = 0;
+  uint64_t _latencyTotal = 0;
+};
+
+struct WI2CTransaction {
+  WI2CDevice* device;
+  // bytes to write, followed by the bytes read
+  uint8_t data[I2C_DATA_SIZE];
+  byte writeLength;
+  byte readLength;
+  unsigned long holdMillis;
+  unsigned long queued;
+  TI2CCallback callback;
+};
+
+/*
+  Owns a TwoWire port and runs the transactions of all devices on it from a
+  queue. A device that waits for a conversion or an eeprom write doesn't
+  stop the others, the transactions of one device keep their order.
+  Callbacks get the read bytes and run from loop(). Every device on the bus
+  calls loop(), the queue is worked once per time stamp only.
+*/
+class WI2CBus {
+ public:
+  // Bus of the port, created with the first device on it
+  static WI2CBus* of(TwoWire* wire) {
+    for (byte i = 0; i < I2C_MAX_BUSES; i++) {
+      if ((I2C_BUSES[i] != nullptr) && (I2C_BUSES[i]->_wire == wire)) return I2C_BUSES[i];
+    }
+    for (byte i = 0; i < I2C_MAX_BUSES; i++) {
+      if (I2C_BUSES[i] == nullptr) return (I2C_BUSES[i] = new WI2CBus(wire));
+    }
+    LOG->error(F("Too many I2C buses"));
+    return nullptr;
+  }
+
+  // Starts the port once, whichever device asks first
+  void begin(int sda, int scl) {
+    if (!_started) {
+      _wire->begin(sda, scl);
+      _started = true;
+    }
+  }
+
+  // false, if the queue is full; holdMillis keeps the device idle after the write
+  bool write(WI2CDevice* device, const uint8_t* data, byte length, TI2CCallback callback = nullptr, unsigned long holdMillis = 0) {
+    return _add(device, data, length, 0, callback, holdMillis);
+  }
+
+  // Write (e.g. a register address), repeated start and read of readLength bytes
+  bool writeRead(WI2CDevice* device, const uint8_t* data, byte writeLength, byte readLength, TI2CCallback callback) {
+    return _add(device, data, writeLength, readLength, callback, 0);
+  }
+
+  // Runs a transaction now, after the queued ones of the device. For setup and reads that need the result at once
+  byte transfer(WI2CDevice* device, const uint8_t* data, byte writeLength, uint8_t* result = nullptr, byte readLength = 0) {
+    if (writeLength + readLength > I2C_DATA_SIZE) return I2C_ERROR_SIZE;
+    for (byte i = 0; i < _count;) {
+      if (_queue[i].device != device) {
+        i++;
+      } else if (device->isReady(millis())) {
+        _run(i);
+      } else {
+        return I2C_ERROR_BUSY;
+      }
+    }
+    if (!device->isReady(millis())) return I2C_ERROR_BUSY;
+    WI2CTransaction t;
+    _set(t, device, data, writeLength, readLength, nullptr, 0);
+    byte error = _execute(t);
+    if ((error == I2C_OK) && (result != nullptr)) memcpy(result, t.data + writeLength, readLength);
+    return error;
+  }
+
+  // Drops the queued transactions of a device without calling back
+  void cancel(WI2CDevice* device) {
+    for (byte i = 0; i < _count;) {
+      if (_queue[i].device == device) {
+        _remove(i);
+      } else {
+        i++;
+      }
+    }
+  }
+
+  void loop(unsigned long now) {
+    if ((_looped) && (now == _loopedAt)) return;
+    _looped = true;
+    _loopedAt = now;
+    byte run = 0;
+    for (byte i = 0; (i < _count) && (run < I2C_TRANSACTIONS_PER_LOOP);) {
+      if ((_queue[i].device->isReady(now)) && (!_isWaiting(i))) {
+        _run(i);
+        run++;
+      } else {
+        i++;
+      }
+    }
+  }
+
+  byte pending() { return _count; }
+
+ private:
+  TwoWire* _wire;
+  bool _started = false;
+  uint32_t _clock = 0;
+  WI2CTransaction _queue[I2C_QUEUE_SIZE];
+  byte _count = 0;
+  bool _looped = false;
+  unsigned long _loopedAt = 0;
+
+  WI2CBus(TwoWire* wire) { _wire = wire; }
+
+  bool _add(WI2CDevice* device, const uint8_t* data, byte writeLength, byte readLength, TI2CCallback callback, unsigned long holdMillis) {
+    if ((_count == I2C_QUEUE_SIZE) || (writeLength + readLength > I2C_DATA_SIZE)) {
+      device->_errors++;
+      device->_lastError = (_count == I2C_QUEUE_SIZE ? I2C_ERROR_BUSY : I2C_ERROR_SIZE);
+      return false;
+    }
+    _set(_queue[_count], device, data, writeLength, readLength, callback, holdMillis);
+    _count++;
+    return true;
+  }
+
+  void _set(WI2CTransaction& t, WI2CDevice* device, const uint8_t* data, byte writeLength, byte readLength, TI2CCallback callback, unsigned long holdMillis) {
+    t.device = device;
+    if (writeLength > 0) memcpy(t.data, data, writeLength);
+    t.writeLength = writeLength;
+    t.readLength = readLength;
+    t.holdMillis = holdMillis;
+    t.queued = micros();
+    t.callback = callback;
+  }
+
+  // An earlier transaction of the same device is still queued
+  bool _isWaiting(byte index) {
+    for (byte i = 0; i < index; i++) {
+      if (_queue[i].device == _queue[index].device) return true;
+    }
+    return false;
+  }
+
+  void _remove(byte index) {
+    for (byte i = index + 1; i < _count; i++) _queue[i - 1] = std::move(_queue[i]);
+    _count--;
+    _queue[_count].callback = nullptr;
+  }
+
+  // Executes and removes the transaction, the callback may queue new ones
+  void _run(byte index) {
+    WI2CTransaction t = std::move(_queue[index]);
+    _remove(index);
+    byte error = _execute(t);
+    if (t.callback) t.callback(error, t.data + t.writeLength, (error == I2C_OK ? t.readLength : 0));
+  }
+
+  byte _execute(WI2CTransaction& t) {
+    WI2CDevice* device = t.device;
+    if (device->_clock != _clock) {
+      _wire->setClock(device->_clock);
+      _clock = device->_clock;
+    }
+    byte error = I2C_OK;
+    if ((t.writeLength > 0) || (t.readLength == 0)) {
+      _wire->beginTransmission(device->_address);
+      _wire->write(t.data, t.writeLength);
+      // no stop before a read, it follows with a repeated start
+      error = _wire->endTransmission(t.readLength == 0);
+    }
+    if ((error == I2C_OK) && (t.readLength > 0)) {
+      if (_wire->requestFrom(device->_address, t.readLength) == t.readLength) {
+        for (byte i = 0; i < t.readLength; i++) t.data[t.writeLength + i] = _wire->read();
+      } else {
+        error = I2C_ERROR_READ;
+      }
+    }
+    uint32_t latency = micros() - t.queued;
+    device->_transactions++;
+    device->_latencyTotal += latency;
+    device->_latencyMax = max(device->_latencyMax, latency);
+    device->_lastError = error;
+    if (error != I2C_OK) device->_errors++;
+    if (t.holdMillis > 0) {
+      device->_readyAt = millis() + t.holdMillis;
+      device->_holding = true;
+    }
+    return error;
+  }
+};
+
+#endif
@@ -9,15 +9,15 @@ class WJson {
     _stream = stream;
   }
 
-  ~WJson() {
+  virtual ~WJson() {
     //_stream = nullptr;
   }
 
-  WJson& beginObject() {
+  virtual WJson& beginObject() {
     return beginObject("");
   }
 
-  WJson& beginObject(const char* name) {
+  virtual WJson& beginObject(const char* name) {
     if (!_separatorAlreadyCalled) {
       _ifSeparator();
       _separatorAlreadyCalled = true;
@@ -30,7 +30,7 @@ class WJson {
     return *this;
   }
 
-  WJson& memberName(const char* name) {
+  virtual WJson& memberName(const char* name) {
     if (name != nullptr) {
       string(name, nullptr);
       _stream->print(WC_DPOINT);
@@ -38,17 +38,17 @@ class WJson {
     return *this;
   }
 
-  WJson& separator() {
+  virtual WJson& separator() {
     _stream->print(WC_COMMA);
     return *this;
   }
 
-  WJson& endObject() {
+  virtual WJson& endObject() {
     _stream->print(WC_SEND);
     return *this;
   }
 
-  WJson& beginArray() {
+  virtual WJson& beginArray() {
     if (!_separatorAlreadyCalled) {
       _ifSeparator();
     }
@@ -57,7 +57,7 @@ class WJson {
     return *this;
   }
 
-  WJson& beginArray(const char* name) {
+  virtual WJson& beginArray(const char* name) {
     if (!_separatorAlreadyCalled) {
       _ifSeparator();
       _separatorAlreadyCalled = true;
@@ -69,7 +69,7 @@ class WJson {
     return *this;
   }
 
-  WJson& endArray() {
+  virtual WJson& endArray() {
     _stream->print(WC_REND);
     return *this;
   }
@@ -94,7 +94,7 @@ class WJson {
     return *this;
   }
 
-  WJson& propertyNull(const char* name) {
+  virtual WJson& propertyNull(const char* name) {
     _ifSeparator();
     _separatorAlreadyCalled = true;
     memberName(name);
@@ -103,7 +103,7 @@ class WJson {
     return *this;
   }
 
-  WJson& propertyBoolean(const char* name, bool value) {
+  virtual WJson& propertyBoolean(const char* name, bool value) {
     _ifSeparator();
     _separatorAlreadyCalled = true;
     memberName(name);
@@ -114,23 +114,27 @@ class WJson {
     return *this;
   }
 
-  WJson& propertyValue(const char* name, WValue* value) {
+  virtual WJson& propertyValue(const char* name, WValue* value, byte precision = DOUBLE_DEFAULT_PRECISION) {
     _ifSeparator();
     _separatorAlreadyCalled = true;
     memberName(name);
-    pValue(value);
+    pValue(value, precision);
     _separatorAlreadyCalled = false;
     return *this;
   }
 
-  WJson& pValue(WValue* value) {
+  virtual WJson& pValue(WValue* value, byte precision = DOUBLE_DEFAULT_PRECISION) {
     if (!_separatorAlreadyCalled)
       _ifSeparator();
-    WValue::toString(_stream, value);
+    if (value->type() == WDataType::STRING) {
+      escape(_stream, value->asString());
+    } else {
+      WValue::toString(_stream, value, precision);
+    }
     return *this;
   }
 
-  WJson& propertyString(const char* name, const char* value, ...) {
+  virtual WJson& propertyString(const char* name, const char* value, ...) {
     _ifSeparator();
     _separatorAlreadyCalled = true;
     memberName(name);
@@ -138,7 +142,7 @@ class WJson {
     va_list arg;
     va_start(arg, value);
     while (value) {
-      WValue::string(_stream, value, nullptr);
+      escape(_stream, value);
       value = va_arg(arg, const char*);
     }
     va_end(arg);
@@ -147,14 +151,14 @@ class WJson {
     return *this;
   }
 
-  WJson& string(const char* text, ...) {
+  virtual WJson& string(const char* text, ...) {
     if (!_separatorAlreadyCalled)
       _ifSeparator();
     _stream->print(WC_QUOTE);
     va_list arg;
     va_start(arg, text);
     while (text) {
-      WValue::string(_stream, text, nullptr);
+      escape(_stream, text);
       text = va_arg(arg, const char*);
     }
     va_end(arg);
@@ -162,19 +166,60 @@ class WJson {
     return *this;
   }
 
-  WJson& onlyString(const char* text1) {
+  virtual WJson& onlyString(const char* text1) {
     if (text1 != nullptr) _stream->print(text1);
     return *this;
   }
 
-  WJson& null() {
+  virtual WJson& null() {
     if (!_separatorAlreadyCalled)
       _ifSeparator();
     _stream->print("null");
     return *this;
   }
 
- private:
+  // JSON string escaping: runs without special chars are written in one piece
+  static void escape(Print* stream, const char* text) {
+    const char* run = text;
+    const char* p = text;
+    for (char c = *p; c != '\0'; c = *(++p)) {
+      if ((c != '"') && (c != '\\') && ((byte)c >= 0x20)) continue;
+      if (p > run) stream->write((const uint8_t*)run, p - run);
+      char buffer[6] = {'\\', c, '0', '0', '0', '0'};
+      byte length = 2;
+      switch (c) {
+        case '"':
+        case '\\':
+          break;
+        case '\n':
+          buffer[1] = 'n';
+          break;
+        case '\r':
+          buffer[1] = 'r';
+          break;
+        case '\t':
+          buffer[1] = 't';
+          break;
+        case '\b':
+          buffer[1] = 'b';
+          break;
+        case '\f':
+          buffer[1] = 'f';
+          break;
+        default:
+          // other control characters as \u00XX
+          buffer[1] = 'u';
+          buffer[4] = '0' + (c >> 4);
+          buffer[5] = "0123456789abcdef"[c & 0x0F];
+          length = 6;
+      }
+      stream->write((const uint8_t*)buffer, length);
+      run = p + 1;
+    }
+    if (p > run) stream->write((const uint8_t*)run, p - run);
+  }
+
+ protected:
   Print* _stream;
   bool _firstElement = true;
   bool _separatorAlreadyCalled = false;
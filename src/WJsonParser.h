@@ -52,6 +52,7 @@ struct WMapItem {
 
 class WJsonParser {
  public:
+  typedef std::function<void(const char* key, const char* value)> TOnKeyValue;
 
   WJsonParser(bool logging = false) {
     _logging = logging;
@@ -72,8 +73,27 @@ class WJsonParser {
     return jp.parse(payload);
   }
 
+  static WList<WValue>* asMap(const char* payload, size_t length) {
+    WJsonParser jp = WJsonParser();
+    return jp.parse(payload, length);
+  }
+
+  // Streams the members of the top level object to onKeyValue, nothing is collected for them
+  static void forEachKeyValue(const char* payload, size_t length, TOnKeyValue onKeyValue) {
+    WJsonParser jp = WJsonParser();
+    jp._onKeyValue = onKeyValue;
+    WList<WValue>* result = jp.parse(payload, length);
+    if (result) delete result;
+  }
+
   WList<WValue>* parse(const char* payload) {
-    for (int i = 0; i < strlen(payload); i++) {
+    return parse(payload, strlen(payload));
+  }
+
+  // payload doesn't need to be null terminated
+  WList<WValue>* parse(const char* payload, size_t length) {
+    HEAP_TAG(HEAP_JSON);
+    for (size_t i = 0; i < length; i++) {
       _parseChar(payload[i]);
     }
     return _stack->peek()->mapOrList;
@@ -93,10 +113,17 @@ class WJsonParser {
   int _unicodeHighSurrogate = 0;
   bool _logging = false;
   char* _currentKey = nullptr;
+  TOnKeyValue _onKeyValue = nullptr;
 
   void _processKeyValue(const char* key, const char* value) {
     WMapItem* peeked = _stack->peek();
-    if (peeked->mapOrList != nullptr) {                   
+    if ((_onKeyValue) && (_stack->size() == 1)) {
+      if ((value != nullptr) && (_currentKey != nullptr)) {
+        _onKeyValue(_currentKey, value);
+      }
+      if (_currentKey) delete _currentKey;
+      _currentKey = nullptr;
+    } else if (peeked->mapOrList != nullptr) {                   
       if (value != nullptr) {
         peeked->mapOrList->add(new WValue(value), _currentKey);        
       }
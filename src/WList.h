@@ -1,6 +1,9 @@
 #ifndef W_LIST_H
 #define W_LIST_H
 
+#include "WArena.h"
+#include "WHeapTracker.h"
+
 /*
   Inspired by Stefan Kremser github.com/spacehuhn
   https://github.com/spacehuhn/SimpleList
@@ -23,15 +26,18 @@ class IWIterable {
 
 template <class T>
 struct WListNode {
-  WListNode(const char* id) {
-    if (id) {
+  WListNode(const char* id, WArena* arena = nullptr) {
+    if ((id) && (arena)) {
+      this->id = (char*)arena->copy(id);
+    } else if (id) {
       this->id = new char[strlen_P(id) + 1];
       strcpy_P(this->id, id);
     }
   }
 
+  // nodes of an arena aren't deleted, their ids are part of it too
   virtual ~WListNode() {
-    if (id) delete id;
+    if (id) delete[] id;
   }
 
   T* value;
@@ -84,8 +90,10 @@ class WList : public IWIterable<T> {
   typedef std::function<void(WListNode<T>* listNode)> TOnListNode;
   typedef std::function<void(WListChange<T> change)> WListListener;
 
-  WList(bool noDoubleIds = false) {
+  // With an arena, nodes and ids are allocated from it while it's current
+  WList(bool noDoubleIds = false, WArena* arena = nullptr) {
     _noDoubleIds = noDoubleIds;
+    _arena = arena;
     _size = 0;
     _firstNode = nullptr;
     _resetCaching();
@@ -100,7 +108,9 @@ class WList : public IWIterable<T> {
   virtual void insert(T* value, int index, const char* id = nullptr) {
     WListNode<T>* newNode = (_noDoubleIds ? _getListNodeById(id) : nullptr);
     if (newNode == nullptr) {
-      WListNode<T>* newNode = new WListNode<T>(id);
+      HEAP_TAG(HEAP_LIST);
+      WArena* arena = WArena::ifCurrent(_arena);
+      WListNode<T>* newNode = (arena ? new (arena->allocate(sizeof(WListNode<T>))) WListNode<T>(id, arena) : new WListNode<T>(id));
 
       bool isString = std::is_same<T, const char>::value;
       newNode->value = value;
@@ -121,7 +131,7 @@ class WList : public IWIterable<T> {
       T* oldItem = newNode->value;
       newNode->value = value;
       _notifyChanged(index, value, newNode->value); 
-      if (oldItem) delete oldItem;      
+      if (oldItem) _deleteValue(oldItem);
     }    
   };
 
@@ -142,9 +152,9 @@ class WList : public IWIterable<T> {
       }
       _notifyRemove(index, nodeToDelete->value);
       if ((freeMemoryForValues) && (nodeToDelete) && (nodeToDelete->value)) {
-        delete nodeToDelete->value;
+        _deleteValue(nodeToDelete->value);
       }
-      delete nodeToDelete;
+      _deleteNode(nodeToDelete);
       _size--;
       _resetCaching();
     }
@@ -188,7 +198,7 @@ class WList : public IWIterable<T> {
             nodePrev->next = nodeToDelete->next;
           }
           node = nodeToDelete->next;
-          delete nodeToDelete;
+          _deleteNode(nodeToDelete);
           result = true;
         } else {
           nodePrev = node;
@@ -338,6 +348,7 @@ class WList : public IWIterable<T> {
  protected:
   int _size;
   bool _noDoubleIds;
+  WArena* _arena;
   WListNode<T>* _firstNode;
   // caching for get() method
   bool _isCached;
@@ -345,6 +356,13 @@ class WList : public IWIterable<T> {
   WListNode<T>* _lastNodeGot;
   WListListener _listener = nullptr;
 
+  void _deleteValue(T* value) { WArena::destroy(_arena, value); }
+
+  // nodes of the arena are released with it
+  void _deleteNode(WListNode<T>* node) {
+    if ((_arena == nullptr) || (!_arena->owns(node))) delete node;
+  }
+
   void _resetCaching() {
     _isCached = false;
     _lastIndexGot = -1;
@@ -368,16 +386,23 @@ class WList : public IWIterable<T> {
 
 };
 
+// strings are arrays or part of an arena
+template <>
+inline void WList<const char>::_deleteValue(const char* value) { WArena::freeString(_arena, value); }
+
 class WStringList : public WList<const char> {
  public:
-  WStringList() : WList<const char>(true) {
+  WStringList(WArena* arena = nullptr) : WList<const char>(true, arena) {
   }
 
   virtual ~WStringList() {
   }
 
   virtual void insert(const char* value, int index, const char* id = nullptr) {
-    if (value) {
+    WArena* arena = WArena::ifCurrent(_arena);
+    if ((value) && (arena)) {
+      WList::insert(arena->copy(value), index, id);
+    } else if (value) {
       char* temp = new char[strlen_P(value) + 1];
       strcpy_P(temp, value);
       WList::insert(temp, index, id);
@@ -385,6 +410,89 @@ class WStringList : public WList<const char> {
   }
 };
 
+/*
+  Flat id to item hash table for lookups in O(1), e.g. of controls in a page
+  tree. Open addressing with linear probing, grows at half load. Ids are not
+  copied and must live as long as the index; the first item put for an id wins.
+*/
+template <typename T>
+class WIndex {
+ public:
+  WIndex(uint16_t capacity = 8) { _allocate(capacity); }
+
+  ~WIndex() { delete[] _entries; }
+
+  void put(const char* id, T* item) {
+    if ((id == nullptr) || (item == nullptr)) return;
+    if ((_size + 1) * 2 > _capacity) _grow();
+    uint32_t h = hash(id);
+    uint16_t i = _find(h, id);
+    if (_entries[i].id != nullptr) return;
+    _entries[i] = {h, id, item};
+    _size++;
+  }
+
+  T* get(const char* id) {
+    if (id == nullptr) return nullptr;
+    return _entries[_find(hash(id), id)].item;
+  }
+
+  uint16_t size() { return _size; }
+
+  void clear() {
+    for (uint16_t i = 0; i < _capacity; i++) _entries[i] = {0, nullptr, nullptr};
+    _size = 0;
+  }
+
+  // FNV-1a
+  static uint32_t hash(const char* id) {
+    uint32_t result = 2166136261UL;
+    for (; *id != '\0'; id++) result = (result ^ (uint8_t)*id) * 16777619UL;
+    return result;
+  }
+
+ private:
+  struct WIndexEntry {
+    uint32_t hash;
+    const char* id;
+    T* item;
+  };
+  WIndexEntry* _entries;
+  uint16_t _capacity;
+  uint16_t _size;
+
+  void _allocate(uint16_t capacity) {
+    // a power of 2, so the slot is a mask of the hash
+    _capacity = 8;
+    while (_capacity < capacity) _capacity <<= 1;
+    HEAP_TAG(HEAP_LIST);
+    _entries = new WIndexEntry[_capacity];
+    clear();
+  }
+
+  // slot of id or the free slot where it belongs
+  uint16_t _find(uint32_t h, const char* id) {
+    uint16_t i = h & (_capacity - 1);
+    while ((_entries[i].id != nullptr) && ((_entries[i].hash != h) || (strcmp(_entries[i].id, id) != 0))) {
+      i = (i + 1) & (_capacity - 1);
+    }
+    return i;
+  }
+
+  void _grow() {
+    WIndexEntry* old = _entries;
+    uint16_t oldCapacity = _capacity;
+    _allocate(_capacity * 2);
+    for (uint16_t i = 0; i < oldCapacity; i++) {
+      if (old[i].id != nullptr) {
+        _entries[_find(old[i].hash, old[i].id)] = old[i];
+        _size++;
+      }
+    }
+    delete[] old;
+  }
+};
+
 template <typename T>
 class WStack : public WList<T> {
  public:
@@ -0,0 +1,182 @@
+#ifndef W_MQTT_ROUTER_H
+#define W_MQTT_ROUTER_H
+
+#include <Arduino.h>
+
+#include "WDevice.h"
+
+#define MQTT_MAX_SEGMENTS 6
+#define MQTT_VALUE_LENGTH 128
+
+// Part of a topic or payload, points into the original buffer and is not null terminated
+struct WMqttSegment {
+  const char* data = nullptr;
+  size_t length = 0;
+
+  bool equals(const char* text) {
+    return ((strncmp(data, text, length) == 0) && (text[length] == '\0'));
+  }
+
+  bool empty() { return (length == 0); }
+
+  // Null terminated copy in buffer. Returns nullptr, if buffer is too small
+  const char* copyTo(char* buffer, size_t size) {
+    if (length >= size) return nullptr;
+    memcpy(buffer, data, length);
+    buffer[length] = '\0';
+    return buffer;
+  }
+};
+
+// Null terminated copy of a segment, kept on stack if shorter than MQTT_VALUE_LENGTH
+struct WMqttString {
+  WMqttString(WMqttSegment* segment) {
+    _heap = (segment->length >= MQTT_VALUE_LENGTH ? new char[segment->length + 1] : nullptr);
+    segment->copyTo(c_str(), segment->length + 1);
+  }
+
+  ~WMqttString() {
+    if (_heap) delete[] _heap;
+  }
+
+  char* c_str() { return (_heap != nullptr ? _heap : _buffer); }
+
+ private:
+  char _buffer[MQTT_VALUE_LENGTH];
+  char* _heap;
+};
+
+struct WMqttDeviceRoute {
+  uint32_t hash;
+  WDevice* device;
+  uint16_t first;
+  uint16_t count;
+};
+
+struct WMqttPropertyRoute {
+  uint32_t hash;
+  const char* id;
+  WProperty* property;
+};
+
+/*
+  Resolves topic segments to devices and properties without copying the topic.
+  Device and property ids are hashed once in build(); each device owns a range
+  of the property table sorted by hash, so a lookup is a binary search.
+*/
+class WMqttRouter {
+ public:
+  ~WMqttRouter() { _clear(); }
+
+  // Splits topic at '/' without copying. Returns the number of segments, 0 if there are too many
+  static byte tokenize(const char* topic, WMqttSegment* segments, byte maxSegments) {
+    byte count = 0;
+    const char* start = topic;
+    for (const char* c = topic;; c++) {
+      if ((*c == '/') || (*c == '\0')) {
+        if (count == maxSegments) return 0;
+        segments[count].data = start;
+        segments[count].length = c - start;
+        count++;
+        if (*c == '\0') return count;
+        start = c + 1;
+      }
+    }
+  }
+
+  // FNV-1a
+  static uint32_t hash(const char* data, size_t length) {
+    uint32_t result = 2166136261UL;
+    for (size_t i = 0; i < length; i++) {
+      result = (result ^ (uint8_t)data[i]) * 16777619UL;
+    }
+    return result;
+  }
+
+  void build(WList<WDevice>* devices) {
+    _clear();
+    _deviceCount = devices->size();
+    _propertyCount = 0;
+    devices->forEach([this](int index, WDevice* device, const char* id) { _propertyCount += device->properties()->size(); });
+    _devices = new WMqttDeviceRoute[_deviceCount];
+    _properties = new WMqttPropertyRoute[_propertyCount];
+    uint16_t p = 0;
+    devices->forEach([this, &p](int index, WDevice* device, const char* id) {
+      WMqttDeviceRoute* route = &_devices[index];
+      route->hash = hash(device->id(), strlen(device->id()));
+      route->device = device;
+      route->first = p;
+      route->count = device->properties()->size();
+      device->properties()->forEach([this, &p](int i, WProperty* property, const char* propertyId) {
+        _properties[p].hash = hash(propertyId, strlen(propertyId));
+        _properties[p].id = propertyId;
+        _properties[p].property = property;
+        p++;
+      });
+      _sort(_properties, route->first, route->count);
+    });
+    _sort(_devices, 0, _deviceCount);
+  }
+
+  WMqttDeviceRoute* device(WMqttSegment* id) {
+    uint32_t h = hash(id->data, id->length);
+    int i = _lowerBound(_devices, 0, _deviceCount, h);
+    for (; (i < _deviceCount) && (_devices[i].hash == h); i++) {
+      if (id->equals(_devices[i].device->id())) return &_devices[i];
+    }
+    return nullptr;
+  }
+
+  WProperty* property(WMqttDeviceRoute* route, WMqttSegment* id) {
+    uint32_t h = hash(id->data, id->length);
+    int i = _lowerBound(_properties, route->first, route->count, h);
+    for (; (i < route->first + route->count) && (_properties[i].hash == h); i++) {
+      if (id->equals(_properties[i].id)) return _properties[i].property;
+    }
+    return nullptr;
+  }
+
+ private:
+  WMqttDeviceRoute* _devices = nullptr;
+  WMqttPropertyRoute* _properties = nullptr;
+  uint16_t _deviceCount = 0;
+  uint16_t _propertyCount = 0;
+
+  void _clear() {
+    if (_devices) delete[] _devices;
+    if (_properties) delete[] _properties;
+    _devices = nullptr;
+    _properties = nullptr;
+  }
+
+  // insertion sort by hash, tables are small and built once
+  template <class R>
+  static void _sort(R* routes, uint16_t first, uint16_t count) {
+    for (int i = first + 1; i < first + count; i++) {
+      R r = routes[i];
+      int j = i - 1;
+      while ((j >= first) && (routes[j].hash > r.hash)) {
+        routes[j + 1] = routes[j];
+        j--;
+      }
+      routes[j + 1] = r;
+    }
+  }
+
+  template <class R>
+  static int _lowerBound(R* routes, uint16_t first, uint16_t count, uint32_t h) {
+    int low = first;
+    int high = first + count;
+    while (low < high) {
+      int mid = (low + high) / 2;
+      if (routes[mid].hash < h) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+    return low;
+  }
+};
+
+#endif
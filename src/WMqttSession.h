@@ -0,0 +1,221 @@
+#ifndef W_MQTT_SESSION_H
+#define W_MQTT_SESSION_H
+
+#include <Arduino.h>
+#include <PubSubClient.h>
+#include <WiFiClient.h>
+
+#include "WList.h"
+#include "WLog.h"
+
+#define MQTT_QUEUE_SIZE 16
+#define MQTT_PUBLISH_PER_LOOP 2
+#define MQTT_RECONNECT_MIN 2000
+#define MQTT_RECONNECT_MAX 300000
+// bound of the blocking TCP connect in ms
+#define MQTT_CONNECT_TIMEOUT 1500
+#define MQTT_SOCKET_TIMEOUT 2
+#define MQTT_TOPIC_LENGTH 64
+
+struct WMqttMessage {
+  WMqttMessage(const char* topic, const uint8_t* payload, size_t length, bool retained) {
+    this->topic = new char[strlen(topic) + 1];
+    strcpy(this->topic, topic);
+    this->payload = new uint8_t[length];
+    memcpy(this->payload, payload, length);
+    this->length = length;
+    this->retained = retained;
+  }
+
+  virtual ~WMqttMessage() {
+    delete[] topic;
+    delete[] payload;
+  }
+
+  char* topic;
+  uint8_t* payload;
+  size_t length;
+  bool retained;
+};
+
+/*
+  Topics of one device, built once when devices or settings change:
+  - state: <idx>/<device id>/<state topic>
+  - set: <idx>/<device id>/<set topic>
+  Property topics are appended to the prefix in a caller's buffer, no heap is used.
+*/
+struct WMqttTopics {
+  WMqttTopics(const char* idx, const char* deviceId, const char* stateTopic, const char* setTopic) {
+    update(idx, deviceId, stateTopic, setTopic);
+  }
+
+  void update(const char* idx, const char* deviceId, const char* stateTopic, const char* setTopic) {
+    stateLength = _build(state, idx, deviceId, stateTopic);
+    setLength = _build(set, idx, deviceId, setTopic);
+  }
+
+  // Writes <state>/<property id> to buffer of size MQTT_TOPIC_LENGTH
+  const char* stateOf(char* buffer, const char* propertyId) {
+    memcpy(buffer, state, stateLength);
+    buffer[stateLength] = '/';
+    strncpy(&buffer[stateLength + 1], propertyId, MQTT_TOPIC_LENGTH - stateLength - 1);
+    buffer[MQTT_TOPIC_LENGTH - 1] = '\0';
+    return buffer;
+  }
+
+  char state[MQTT_TOPIC_LENGTH];
+  char set[MQTT_TOPIC_LENGTH];
+  byte stateLength;
+  byte setLength;
+
+ private:
+  byte _build(char* buffer, const char* idx, const char* deviceId, const char* topic) {
+    int length = snprintf(buffer, MQTT_TOPIC_LENGTH, "%s/%s/%s", idx, deviceId, topic);
+    if (length >= MQTT_TOPIC_LENGTH) {
+      LOG->error(F("MQTT topic too long, truncated: '%s'"), buffer);
+      length = MQTT_TOPIC_LENGTH - 1;
+    }
+    return length;
+  }
+};
+
+/*
+  Wraps PubSubClient so that the device loop is held up by the broker as
+  little as possible:
+  - connect() blocks, PubSubClient has no asynchronous connect; the TCP
+    connect is bounded by MQTT_CONNECT_TIMEOUT and retried with backoff
+  - publish() only enqueues; the queue is drained a few messages per loop
+  - messages to the same topic are coalesced, only the latest payload is kept
+  - the queue is bounded, if full the oldest message is dropped
+  - reconnects use exponential backoff between MQTT_RECONNECT_MIN and MQTT_RECONNECT_MAX
+*/
+class WMqttSession {
+ public:
+  typedef std::function<void()> THandlerFunction;
+
+  WMqttSession(WiFiClient* client, uint16_t bufferSize) {
+    _client = client;
+    _mqttClient = new PubSubClient(*client);
+    _mqttClient->setBufferSize(bufferSize);
+    _mqttClient->setSocketTimeout(MQTT_SOCKET_TIMEOUT);
+    _queue = new WList<WMqttMessage>(true);
+  }
+
+  ~WMqttSession() {
+    delete _queue;
+    delete _mqttClient;
+  }
+
+  PubSubClient* client() { return _mqttClient; }
+
+  bool connected() { return _mqttClient->connected(); }
+
+  void disconnect() {
+    if (connected()) {
+      _mqttClient->disconnect();
+    }
+  }
+
+  // true, if no connection and the backoff time since last failed try is over
+  bool isReconnectDue(unsigned long now) {
+    return ((!connected()) && ((_lastConnect == 0) || (now - _lastConnect >= _reconnectDelay)));
+  }
+
+  void resetBackoff() {
+    _lastConnect = 0;
+    _reconnectDelay = MQTT_RECONNECT_MIN;
+  }
+
+  // The last will may be binary (CBOR), willLength is its size
+  bool connect(unsigned long now, const char* server, uint16_t port, const char* clientId, const char* user, const char* password,
+               const char* willTopic = nullptr, const uint8_t* willMessage = nullptr, size_t willLength = 0) {
+    _lastConnect = now;
+#if defined(ARDUINO_ARCH_ESP32) && ((!defined(ESP_ARDUINO_VERSION_MAJOR)) || (ESP_ARDUINO_VERSION_MAJOR < 3))
+    // seconds before core 3.0 of the ESP32
+    _client->setTimeout((MQTT_CONNECT_TIMEOUT + 999) / 1000);
+#else
+    _client->setTimeout(MQTT_CONNECT_TIMEOUT);
+#endif
+    _mqttClient->setServer(server, port);
+    // PubSubClient takes the will as a terminated string, a payload with a 0x00 byte would be cut
+    if ((willTopic != nullptr) && (memchr(willMessage, 0, willLength) != nullptr)) {
+      LOG->error(F("MQTT last will contains a zero byte, connect without"));
+      willTopic = nullptr;
+    }
+    bool result = (willTopic != nullptr ? _mqttClient->connect(clientId, user, password, willTopic, 0, true, (const char*)willMessage)
+                                        : _mqttClient->connect(clientId, user, password));
+    if (result) {
+      _reconnectDelay = MQTT_RECONNECT_MIN;
+    } else {
+      _failedConnects++;
+      _reconnectDelay = min(_reconnectDelay * 2, (unsigned long) MQTT_RECONNECT_MAX);
+      LOG->notice(F("MQTT connect failed, rc=%d; next try in %d s"), _mqttClient->state(), _reconnectDelay / 1000);
+    }
+    return result;
+  }
+
+  // Enqueues a message. If coalesce is true, an older message to the same topic is replaced.
+  bool publish(const char* topic, const uint8_t* payload, size_t length, bool retained = false, bool coalesce = true) {
+    HEAP_TAG(HEAP_MQTT);
+    if ((coalesce) && (_queue->existsId(topic))) {
+      _coalesced++;
+    } else if (_queue->size() >= MQTT_QUEUE_SIZE) {
+      _queue->remove(0, true);
+      _dropped++;
+    }
+    _queue->add(new WMqttMessage(topic, payload, length, retained), (coalesce ? topic : nullptr));
+    _maxQueueDepth = max(_maxQueueDepth, (uint16_t)_queue->size());
+    return true;
+  }
+
+  bool publish(const char* topic, const char* payload, bool retained = false, bool coalesce = true) {
+    return publish(topic, (const uint8_t*)payload, strlen(payload), retained, coalesce);
+  }
+
+  void loop(unsigned long now) {
+    if (connected()) {
+      _mqttClient->loop();
+      for (byte i = 0; (i < MQTT_PUBLISH_PER_LOOP) && (!_queue->empty()) && (connected()); i++) {
+        WMqttMessage* message = _queue->get(0);
+        if (_mqttClient->publish(message->topic, message->payload, message->length, message->retained)) {
+          _published++;
+          _queue->remove(0, true);
+        } else {
+          // keep message for next connection
+          LOG->notice(F("Sending MQTT message failed, rc=%d"), _mqttClient->state());
+          _mqttClient->disconnect();
+        }
+      }
+    }
+  }
+
+  void clearQueue() { _queue->clear(); }
+
+  uint16_t queueDepth() { return _queue->size(); }
+
+  uint16_t maxQueueDepth() { return _maxQueueDepth; }
+
+  unsigned long dropped() { return _dropped; }
+
+  unsigned long coalesced() { return _coalesced; }
+
+  unsigned long published() { return _published; }
+
+  unsigned long failedConnects() { return _failedConnects; }
+
+  unsigned long reconnectDelay() { return _reconnectDelay; }
+
+ private:
+  WiFiClient* _client;
+  PubSubClient* _mqttClient;
+  WList<WMqttMessage>* _queue;
+  unsigned long _lastConnect = 0;
+  unsigned long _reconnectDelay = MQTT_RECONNECT_MIN;
+  uint16_t _maxQueueDepth = 0;
+  unsigned long _dropped = 0;
+  unsigned long _coalesced = 0;
+  unsigned long _published = 0;
+  unsigned long _failedConnects = 0;
+};
+
+#endif
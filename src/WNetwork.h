@@ -12,15 +12,19 @@
 #include <ESPmDNS.h>
 #include <Update.h>
 #include <WiFi.h>
-#define U_PART U_FLASH
+#define U_PART U_SPIFFS
 #endif
 #include <DNSServer.h>
 #include <PubSubClient.h>
 #include <StreamString.h>
 
+#include "WCborParser.h"
 #include "WDevice.h"
+#include "WFirmwareUpdate.h"
 #include "WJsonParser.h"
 #include "WList.h"
+#include "WMqttRouter.h"
+#include "WMqttSession.h"
 #include "WSettings.h"
 #include "WStringStream.h"
 #include "WiFiClient.h"
@@ -32,12 +36,33 @@
 #define ESP_MAX_PUT_BODY_SIZE 512
 #define WIFI_RECONNECTION 50000
 #define WIFI_RECONNECTION_TRYS 3
+#define WIFI_CONNECT_TIMEOUT 5000
+#define RESTART_DELAY 1000
+#define DEEP_SLEEP_DELAY 500
+#define SIZE_MQTT_REJECTED 128
+// raw image upload: PUT with X-Sha256 and optional Content-Range, GET for the state to resume
+#define OTA_PATH "/ota"
 const char* CONFIG_PASSWORD = "12345678";
 const char* APPLICATION_JSON = "application/json";
 const char* TEXT_PLAIN = "text/plain";
 const char* DEFAULT_TOPIC_STATE = "properties";
 const char* DEFAULT_TOPIC_SET = "set";
 const char* SLASH = "/";
+#ifdef W_PROFILER
+const char* PROFILE_MQTT = "mqtt";
+const char* PROFILE_WEB_APP = "webApp";
+const char* PROFILE_MDNS = "mdns";
+const char* DEFAULT_TOPIC_DIAG = "diag";
+#endif
+#ifdef W_HEAP_TRACKING
+const char* DEFAULT_TOPIC_HEAP = "heap";
+#endif
+
+enum WWifiState {
+  WIFI_STATE_IDLE,
+  WIFI_STATE_CONNECTING,
+  WIFI_STATE_CONNECTED
+};
 
 #ifdef ARDUINO_ARCH_ESP8266
 WiFiEventHandler gotIpEventHandler, disconnectedEventHandler;
@@ -62,22 +87,22 @@ class WNetwork {
     _webServer = nullptr;
     _dnsApServer = nullptr;
     _devices = new WList<WDevice>();
+    _mqttTopics = new WList<WMqttTopics>();
+    _mqttRouter = new WMqttRouter();
 
     this->setDebuggingOutput(debuggingOutput);
     _updateRunning = false;
     _deepSleepFlag = nullptr;
-    _waitForWifiConnection = false;
     _startupTime = millis();
     _loadNetworkSettings();
-    _lastMqttConnect = _lastWifiConnect = 0;
+    _lastWifiConnect = 0;
     _initialMqttSent = false;
     _lastWillEnabled = true;
     _wifiConnectTrys = 0;
 
     if (this->isSupportingMqtt()) {
-      _mqttClient = new PubSubClient(*_wifiClient);
-      _mqttClient->setBufferSize(SIZE_JSON_PACKET);
-      _mqttClient->setCallback(std::bind(&WNetwork::_mqttCallback, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+      _mqtt = new WMqttSession(_wifiClient, SIZE_JSON_PACKET);
+      _mqtt->client()->setCallback(std::bind(&WNetwork::_mqttCallback, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
     }
 #ifdef ARDUINO_ARCH_ESP8266
     gotIpEventHandler = WiFi.onStationModeGotIP([this](const WiFiEventStationModeGotIP& event) { onGotIP(); });
@@ -98,12 +123,24 @@ class WNetwork {
     this->addWebPage(WC_WIFI, [this]() { return new WNetworkPage(); }, PSTR("Configure network"));
     this->addWebPage(WC_FIRMWARE, [this]() { return new WFirmwarePage(); }, PSTR("Firmware"));
     this->addWebPage(WC_INFO, [this]() { return new WInfoPage((millis() - _startupTime) / 1000 / 60); }, PSTR("Info"));
+#ifdef W_PROFILER
+    this->addWebPage(WC_PROFILER, []() { return new WProfilerPage(); }, PSTR("Loop times [µs]"));
+    _profileMqtt = PROFILE_SLOT(PROFILE_MQTT, PROFILE_NO_SLOT);
+    _profileWebApp = PROFILE_SLOT(PROFILE_WEB_APP, PROFILE_NO_SLOT);
+    _profileMdns = PROFILE_SLOT(PROFILE_MDNS, PROFILE_NO_SLOT);
+#endif
     this->addWebPage(WC_RESET, [this]() { return new WResetPage(this); }, PSTR("Reboot"));
   }
 
   ~WNetwork() {
     delete SETTINGS;
     delete _devices;
+    delete _mqttTopics;
+    delete _mqttRouter;
+    if (WEB_STATE) delete WEB_STATE;
+    WEB_STATE = nullptr;
+    if (FIRMWARE_UPDATE) delete FIRMWARE_UPDATE;
+    FIRMWARE_UPDATE = nullptr;
     if (_webServer) delete _webServer;
     if (_dnsApServer) delete _dnsApServer;
     if (_webApp) delete _webApp;
@@ -128,14 +165,16 @@ class WNetwork {
   void onGotIP() {
     LOG->notice(F("Station connected, IP: %s Host Name is '%s'"), this->getDeviceIp().toString().c_str(), _hostname);
     _wifiConnectTrys = 0;
+    _wifiState = WIFI_STATE_CONNECTED;
     _notify(false);
   }
 
   void onDisconnected() {
+    _wifiState = WIFI_STATE_IDLE;
     if (!isSoftAP()) {
       LOG->notice("Station disconnected");
       this->disconnectMqtt();
-      _lastMqttConnect = 0;
+      if (_mqtt != nullptr) _mqtt->resetBackoff();
       this->stopWebServer();
       _notify(false);
     }
@@ -166,6 +205,12 @@ class WNetwork {
           _dnsApServer->setErrorReplyCode(DNSReplyCode::NoError);
           _dnsApServer->start(53, "*", WiFi.softAPIP());
           this->startWebServer();
+        } else if (_wifiState == WIFI_STATE_CONNECTING) {
+          // onGotIP or onDisconnected will finish the attempt, otherwise give up after timeout
+          if (now - _lastWifiConnect >= WIFI_CONNECT_TIMEOUT) {
+            LOG->notice(F("Connecting to '%s' timed out"), getSsid());
+            _wifiState = WIFI_STATE_IDLE;
+          }
         } else if ((_wifiConnectTrys < WIFI_RECONNECTION_TRYS) &&
                    ((_lastWifiConnect == 0) ||
                     (now - _lastWifiConnect > WIFI_RECONNECTION))) {
@@ -184,13 +229,8 @@ class WNetwork {
           WiFi.setHostname(_hostname);
 #endif
           WiFi.mode(WIFI_STA);
+          _wifiState = WIFI_STATE_CONNECTING;
           WiFi.begin(getSsid(), getPassword());
-          while ((_waitForWifiConnection) && (WiFi.status() != WL_CONNECTED)) {
-            delay(100);
-            if (millis() - now >= 5000) {
-              break;
-            }
-          }
           if (_wifiConnectTrys == 1) {
             _lastWifiConnectFirstTry = now;
           }
@@ -210,18 +250,23 @@ class WNetwork {
     }
     // MQTT connection
     if ((isWifiConnected()) && (isSupportingMqtt()) &&
-        (!_mqttClient->connected()) &&
-        ((_lastMqttConnect == 0) || (now - _lastMqttConnect > 300000)) &&
+        (_mqtt->isReconnectDue(now)) &&
         (strcmp(mqttServer(), "") != 0) &&
         (strcmp(mqttPort(), "") != 0)) {
-      _mqttReconnect();
-      _lastMqttConnect = now;
+      _mqttReconnect(now);
+    }
+    // Firmware update: an interrupted upload that wasn't resumed or a failed one lets the other loops run again
+    if ((isUpdateRunning()) && (FIRMWARE_UPDATE != nullptr)) {
+      FIRMWARE_UPDATE->loop(now);
+      if (!FIRMWARE_UPDATE->isRunning()) _updateRunning = false;
     }
     if (!isUpdateRunning()) {
-      if ((!isUpdateRunning()) && (this->isMqttConnected())) {
-        _mqttClient->loop();
+      if ((_mqtt != nullptr) && (isWifiConnected())) {
+        PROFILE_SCOPE(_profileMqtt);
+        _mqtt->loop(now);
       }
       if (_webApp != nullptr) {
+        PROFILE_SCOPE(_profileWebApp);
         _webApp->loop(now);
       }
       // Loop led
@@ -232,7 +277,10 @@ class WNetwork {
       bool stateUpd = false;
       // Loop Devices
       _devices->forEach([this, now](int index, WDevice* device, const char* id) {
-        device->loop(now);
+        {
+          PROFILE_SCOPE(device->profileSlot());
+          device->loop(now);
+        }
         if ((this->isMqttConnected()) && (this->isSupportingMqtt()) &&
             ((device->lastStateNotify() == 0) ||
              ((device->stateNotifyInterval() > 0) &&
@@ -248,27 +296,43 @@ class WNetwork {
 // WebThingAdapter
 #ifdef ARDUINO_ARCH_ESP8266
       if ((!isUpdateRunning()) && (MDNS.isRunning()) && (isWifiConnected())) {
+        PROFILE_SCOPE(_profileMdns);
         MDNS.update();
       }
+#endif
+#ifdef W_PROFILER
+      if ((isMqttConnected()) && (now - _lastDiagPublish >= PROFILE_PUBLISH_INTERVAL)) {
+        _lastDiagPublish = now;
+        _mqttSendDiagnostics();
+      }
+#endif
+#ifdef W_HEAP_TRACKING
+      if ((isMqttConnected()) && (now - _lastHeapPublish >= HEAP_PUBLISH_INTERVAL)) {
+        _lastHeapPublish = now;
+        _mqttSendHeap();
+      }
 #endif
     }
-    // Restart required?
+    // Restart required? Loops keep running until the delay is over, so pending responses are sent
     if (_restartFlag) {
-      _updateRunning = false;
-      if (_onConfigurationFinished) {
-        _onConfigurationFinished();
+      if (_shutdownTime == 0) {
+        _updateRunning = false;
+        if (_onConfigurationFinished) {
+          _onConfigurationFinished();
+        }
+        _shutdownTime = max(now, 1UL);
+      } else if (now - _shutdownTime >= RESTART_DELAY) {
+        stopWebServer();
+        ESP.restart();
       }
-      delay(1000);
-      stopWebServer();
-      ESP.restart();
-      delay(2000);
     } else if (_deepSleepFlag != nullptr) {
-      if (_deepSleepFlag->off()) {
+      if ((_shutdownTime == 0) && (_deepSleepFlag->off())) {
         // Deep Sleep
         LOG->notice(F("Go to deep sleep. Bye..."));
         _updateRunning = false;
         stopWebServer();
-        delay(500);
+        _shutdownTime = max(now, 1UL);
+      } else if ((_shutdownTime != 0) && (now - _shutdownTime >= DEEP_SLEEP_DELAY)) {
         if (_deepSleepFlag->deepSleepSeconds() > 0) {
           ESP.deepSleep(_deepSleepFlag->deepSleepSeconds() * 1000 * 1000);
         } else if (_deepSleepFlag->deepSleepMode() == DEEP_SLEEP_GPIO_HIGH) {
@@ -288,11 +352,25 @@ class WNetwork {
         } else {
           LOG->notice(F("Going to deep sleep failed. Seconds or GPIO missing..."));
         }
+        _shutdownTime = 0;
       }
     }
     return result;
   }
 
+  // Milliseconds until loop() has work to do again, e.g. to enable light sleep between loops
+  unsigned long timeUntilNextLoop(unsigned long now) {
+    if ((isUpdateRunning()) || (_restartFlag) || (_shutdownTime != 0) || (isSoftAP()) ||
+        ((_mqtt != nullptr) && (_mqtt->queueDepth() > 0))) {
+      return 0;
+    }
+    unsigned long result = SCHEDULER_MAX_IDLE;
+    _devices->forEach([now, &result](int index, WDevice* device, const char* id) {
+      result = min(result, device->timeUntilNextLoop(now));
+    });
+    return result;
+  }
+
   void setDebuggingOutput(Print* output) {
     _debuggingOutput = output;
     LOG->setOutput(output, (DEBUG ? LOG_LEVEL_NOTICE : LOG_LEVEL_SILENT), true, true);
@@ -304,17 +382,10 @@ class WNetwork {
     _onConfigurationFinished = onConfigurationFinished;
   }
 
-  bool publishMqtt(const char* topic, WStringStream* response, bool retained = false) {
-    LOG->notice(F("MQTT... '%s'; %s"), topic, response->c_str());
+  // Queues the message, it's sent by the next loops. Same topics are coalesced, if coalesce is true
+  bool publishMqtt(const char* topic, WStringStream* response, bool retained = false, bool coalesce = true) {
     if (isMqttConnected()) {
-      if (_mqttClient->publish(topic, response->c_str(), retained)) {
-        LOG->notice(F("MQTT sent. Topic: '%s'"), topic);
-        return true;
-      } else {
-        LOG->notice(F("Sending MQTT message failed, rc=%d"), _mqttClient->state());
-        this->disconnectMqtt();
-        return false;
-      }
+      return _mqtt->publish(topic, (const uint8_t*)response->c_str(), response->length(), retained, coalesce);
     } else {
       if (strcmp(mqttServer(), "") != 0) {
         LOG->notice(F("Can't send MQTT. Not connected to server: %s"), mqttServer());
@@ -325,6 +396,7 @@ class WNetwork {
   }
 
   bool publishMqtt(const char* topic, const char* key, const char* value) {
+    HEAP_TAG(HEAP_MQTT);
     if ((this->isMqttConnected()) && (this->isSupportingMqtt())) {
       WStringStream* response = createResponseStream();
       WJson* json = new WJson(response);
@@ -332,8 +404,9 @@ class WNetwork {
       json->propertyString(key, value, nullptr);
       json->endObject();
       delete json;
-      return publishMqtt(topic, response);
+      bool result = publishMqtt(topic, response);
       delete response;
+      return result;
     } else {
       return false;
     }
@@ -362,6 +435,9 @@ class WNetwork {
                                std::placeholders::_3, std::placeholders::_4,
                                std::placeholders::_5, std::placeholders::_6),
                      std::bind(&WNetwork::_handleHttpFinishEvent, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4, std::placeholders::_5));
+      _webServer->on(OTA_PATH, HTTP_GET, [this](AsyncWebServerRequest* request) { _sendFirmwareUpdateState(request, 200); });
+      _webServer->on(OTA_PATH, HTTP_PUT, std::bind(&WNetwork::_handleFirmwareUpload, this, std::placeholders::_1), nullptr,
+                     std::bind(&WNetwork::_handleFirmwareUploadBody, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4, std::placeholders::_5));
       // WebThings
       if ((aDeviceNeedsWebThings) && (this->isWifiConnected())) {
         // Make the thing discoverable
@@ -435,12 +511,12 @@ class WNetwork {
   }
 
   bool isMqttConnected() {
-    return ((this->isSupportingMqtt()) && (_mqttClient != nullptr) && (_mqttClient->connected()));
+    return ((this->isSupportingMqtt()) && (_mqtt != nullptr) && (_mqtt->connected()));
   }
 
   void disconnectMqtt() {
     if (isMqttConnected()) {
-      _mqttClient->disconnect();
+      _mqtt->disconnect();
     }
   }
 
@@ -454,6 +530,8 @@ class WNetwork {
     _supportsWebServer = supportsWebServer;
   }
 
+  WMqttSession* mqttSession() { return _mqtt; }
+
   bool isSupportingMqtt() { return ((_supportingMqtt->asBool()) && (strcmp(mqttServer(), "") != 0)); }
 
   bool isInitialMqttSent() { return _initialMqttSent; }
@@ -464,6 +542,13 @@ class WNetwork {
     _lastWillEnabled = lastWillEnabled;
   }
 
+  WPayloadFormat mqttPayloadFormat() { return _mqttPayloadFormat; }
+
+  // Encoding of device states and set messages on MQTT, JSON or CBOR
+  void setMqttPayloadFormat(WPayloadFormat mqttPayloadFormat) {
+    _mqttPayloadFormat = mqttPayloadFormat;
+  }
+
   const char* getIdx() { return _idx->asString(); }
 
   const char* getHostName() { return _hostname; }
@@ -486,6 +571,13 @@ class WNetwork {
 
   void addDevice(WDevice* device) {
     _devices->add(device);
+    _mqttTopics->add(new WMqttTopics(getIdx(), device->id(), mqttStateTopic(), mqttSetTopic()), device->id());
+    _mqttRouter->build(_devices);
+    if (WEB_STATE == nullptr) WEB_STATE = new WebStatePush();
+    WEB_STATE->build(_devices);
+#ifdef W_PROFILER
+    device->profileSlot(PROFILE_SLOT(device->id(), PROFILE_NO_SLOT));
+#endif
     _bindWebServerCalls(device);
   }
 
@@ -526,7 +618,7 @@ class WNetwork {
       response->print(WC_QUOTE);
       json->endObject();
       delete json;
-      publishMqtt(_idx->asString(), response);
+      publishMqtt(_idx->asString(), response, false, false);
       delete response;
     }
   }
@@ -540,10 +632,15 @@ class WNetwork {
 
  private:
   WList<WDevice>* _devices;
+  WList<WMqttTopics>* _mqttTopics;
+  WMqttRouter* _mqttRouter;
   THandlerFunction _onNotify;
   THandlerFunction _onConfigurationFinished;
   bool _updateRunning;
   bool _restartFlag = false;
+  // state of the current raw firmware upload request
+  size_t _otaFirst = 0;
+  int _otaStatus = 200;
   DNSServer* _dnsApServer;
   AsyncWebServer* _webServer;
   int _networkState;
@@ -555,8 +652,8 @@ class WNetwork {
   WValue* _mqttSetTopic;
   WValue* _mqttStateTopic;
   WiFiClient* _wifiClient;
-  PubSubClient* _mqttClient = nullptr;
-  unsigned long _lastMqttConnect, _lastWifiConnect, _lastWifiConnectFirstTry;
+  WMqttSession* _mqtt = nullptr;
+  unsigned long _lastWifiConnect, _lastWifiConnectFirstTry;
   byte _wifiConnectTrys;
   WLed* _statusLed;
   bool _statusLedOnIfConnected;
@@ -567,9 +664,67 @@ class WNetwork {
   Print* _debuggingOutput;
   bool _initialMqttSent;
   bool _lastWillEnabled;
-  bool _waitForWifiConnection;
+  WPayloadFormat _mqttPayloadFormat = PAYLOAD_JSON;
+  volatile WWifiState _wifiState = WIFI_STATE_IDLE;
+  unsigned long _shutdownTime = 0;
   WFormResponse _postResponse = WFormResponse(FO_NONE);
   WebApp* _webApp = nullptr;
+#ifdef W_PROFILER
+  byte _profileMqtt, _profileWebApp, _profileMdns;
+  unsigned long _lastDiagPublish = 0;
+
+  // Publishes the loop times of the last window to '<idx>/diag' and starts a new window
+  void _mqttSendDiagnostics() {
+    HEAP_TAG(HEAP_MQTT);
+    char topic[MQTT_TOPIC_LENGTH];
+    snprintf(topic, MQTT_TOPIC_LENGTH, "%s/%s", getIdx(), DEFAULT_TOPIC_DIAG);
+    WStringStream* response = createResponseStream();
+    WJson* json = new WJson(response);
+    PROFILER->toJson(json);
+    delete json;
+    publishMqtt(topic, response);
+    delete response;
+    PROFILER->reset();
+  }
+#endif
+#ifdef W_HEAP_TRACKING
+  unsigned long _lastHeapPublish = 0;
+
+  // Publishes heap usage per allocation tag to '<idx>/heap' and starts a new peak window
+  void _mqttSendHeap() {
+    HEAP_TAG(HEAP_MQTT);
+    char topic[MQTT_TOPIC_LENGTH];
+    snprintf(topic, MQTT_TOPIC_LENGTH, "%s/%s", getIdx(), DEFAULT_TOPIC_HEAP);
+    WStringStream* response = createResponseStream();
+    WJson* json = new WJson(response);
+    json->beginObject();
+    WValue v((uint32_t)ESP.getFreeHeap());
+    json->propertyValue("free", &v);
+    v.asUnsignedLong(WHeapTracker::largestFreeBlock());
+    json->propertyValue("largestBlock", &v);
+    v.asUnsignedLong(WHeapTracker::allocations());
+    json->propertyValue("allocations", &v);
+    char name[12];
+    for (byte i = 0; i < HEAP_TAG_COUNT; i++) {
+      WHeapStats* stats = WHeapTracker::stats(i);
+      json->beginObject(WHeapTracker::name(i, name, sizeof(name)));
+      v.asUnsignedLong(stats->bytes);
+      json->propertyValue("bytes", &v);
+      v.asUnsignedLong(stats->peakBytes);
+      json->propertyValue("peakBytes", &v);
+      v.asUnsignedLong(stats->count);
+      json->propertyValue("count", &v);
+      v.asUnsignedLong(stats->peakCount);
+      json->propertyValue("peakCount", &v);
+      json->endObject();
+    }
+    json->endObject();
+    delete json;
+    publishMqtt(topic, response);
+    delete response;
+    WHeapTracker::resetPeaks();
+  }
+#endif
 
   bool _aDeviceNeedsWebThings() {
     return (_devices->getIf([](WDevice* d) { return d->needsWebThings(); }) != nullptr);
@@ -577,17 +732,18 @@ class WNetwork {
 
   void _handleDeviceStateChange(WDevice* device, bool complete) {
     LOG->notice(F("Device state changed -> send device state for device '%s'"), device->id());
-    String topic = String(getIdx()) + SLASH + String(device->id()) + SLASH + String(mqttStateTopic());
-    _mqttSendDeviceState(topic, device, complete);
+    _mqttSendDeviceState(device, complete);
   }
 
-  void _mqttSendDeviceState(String topic, WDevice* device, bool complete) {
+  void _mqttSendDeviceState(WDevice* device, bool complete) {
+    HEAP_TAG(HEAP_MQTT);
     if ((this->isMqttConnected()) && (isSupportingMqtt()) && (device->isDeviceStateComplete())) {
       LOG->notice(F("Send actual device state via MQTT"));
+      WMqttTopics* topics = _mqttTopics->getById(device->id());
 
       if (device->sendCompleteDeviceState()) {
         WStringStream* response = createResponseStream();
-        WJson* json = new WJson(response);
+        WJson* json = WCbor::create(response, _mqttPayloadFormat);
         json->beginObject();
         if (device->isMainDevice()) {
           json->propertyString("idx", getIdx(), nullptr);
@@ -600,19 +756,20 @@ class WNetwork {
         device->toJsonValues(json, MQTT);
         json->endObject();
         delete json;
-        _mqttClient->publish(topic.c_str(), (const uint8_t*)response->c_str(), response->length(), true);
+        publishMqtt(topics->state, response, true);
         delete response;
         _initialMqttSent = true;
       } else {
         device->properties()->forEach(
-            [this, complete, topic](int index, WProperty* property, const char* id) {
+            [this, complete, topics](int index, WProperty* property, const char* id) {
               if ((complete) || (property->changed())) {
                 if (property->isVisible(MQTT)) {
                   WStringStream* response = createResponseStream();
-                  WJson* json = new WJson(response);
+                  WJson* json = WCbor::create(response, _mqttPayloadFormat);
                   property->toJsonValue(json);
                   delete json;
-                  _mqttClient->publish(String(topic + SLASH + String(id)).c_str(), response->c_str(), true);
+                  char topic[MQTT_TOPIC_LENGTH];
+                  publishMqtt(topics->stateOf(topic, id), response, true);
                   delete response;
                 }
                 property->changed(false);
@@ -632,120 +789,135 @@ class WNetwork {
   }
 
   void _mqttCallback(char* ptopic, uint8_t* payload, unsigned int length) {
-    payload[length] = '\0';
-    LOG->notice(F("Received MQTT callback. topic: '%s'; payload: '%s'; length: %d"), ptopic, (char*)payload, length);
-    String baseT = String(getIdx());
-    String stateT = String(mqttStateTopic());
-    String setT = String(mqttSetTopic());
-
-    String cTopic = String(ptopic);
-    if (cTopic.startsWith(baseT)) {
-      String topic = cTopic.substring(baseT.length() + 1);
-      LOG->notice(F("Topic short '%s'"), topic.c_str());
-      // Next is device id
-      int i = topic.indexOf(SLASH);
-      if (i > -1) {
-        String deviceId = topic.substring(0, i);
-        LOG->notice(F("look for device id '%s'"), deviceId.c_str());
-        WDevice* device = _getDeviceById(deviceId.c_str());
-        if (device != nullptr) {
-          topic = topic.substring(i + 1);
-          if (topic.startsWith(stateT)) {
-            if (length == 0) {
-              // State request
-              topic = topic.substring(stateT.length() + 1);
-              if (topic.equals("")) {
-                // send all propertiesBase
-                LOG->notice(F("Send complete device state..."));
-                // Empty payload for topic 'properties' -> send device state
-                _mqttSendDeviceState(String(ptopic), device, true);
-              } else {
-                WProperty* property = device->getPropertyById(topic.c_str());
-                if (property != nullptr) {
-                  if (property->isVisible(MQTT)) {
-                    LOG->notice(F("Send state of property '%s'"),
-                                topic);
-                    WStringStream* response = createResponseStream();
-                    WJson* json = new WJson(response);
-                    property->toJsonValue(json);
-                    delete json;
-                    _mqttClient->publish(String(baseT + SLASH + deviceId + SLASH + stateT + SLASH + topic).c_str(), response->c_str(), true);
-                    delete response;
-                  }
-                } else {
-                  device->handleUnknownMqttCallback(true, ptopic, topic, (char*)payload, length);
-                }
-              }
-            }
-          } else if (topic.startsWith(setT)) {
-            if (length > 0) {
-              // Set request
-              topic = topic.substring(setT.length() + 1);
-              if (topic.equals("")) {
-                // set all properties
-                LOG->notice(F("Try to set several properties for device %s"), device->id());
-                WList<WValue>* properties = WJsonParser::asMap(_body_data);
-                LOG->debug("list items count: %d", properties->size());
-                for (int i = 0; i < properties->size(); i++) {
-                  WValue* value = properties->get(i);
-                  const char* id = properties->getId(i);
-                  WProperty* property = device->getPropertyById(id);
-                  if (property != nullptr) {
-                    LOG->notice(F("Set property '%s' to value '%s' (mqtt request)"), id, value->toString());
-                    property->parse(value->asString());
-                  } else {
-                    LOG->notice(F("Property '%s' not found for device %s"), id, device->id());
-                  }
-                }
-                delete properties;
+    HEAP_TAG(HEAP_MQTT);
+    LOG->notice(F("Received MQTT callback. topic: '%s'; length: %d"), ptopic, length);
+    // <idx>/<device id>/<state or set topic>[/<property id>], payload is not null terminated
+    WMqttSegment topic[MQTT_MAX_SEGMENTS];
+    byte count = WMqttRouter::tokenize(ptopic, topic, MQTT_MAX_SEGMENTS);
+    if ((count < 3) || (!topic[0].equals(getIdx()))) return;
+    WMqttSegment body;
+    body.data = (const char*)payload;
+    body.length = length;
+    WMqttDeviceRoute* route = _mqttRouter->device(&topic[1]);
+    if (route != nullptr) {
+      WDevice* device = route->device;
+      bool isState = topic[2].equals(mqttStateTopic());
+      if ((!isState) && (!topic[2].equals(mqttSetTopic()))) {
+        // neither state nor set topic
+        return;
+      }
+      // property id is the rest of the topic
+      WMqttSegment propertyId;
+      if (count > 3) {
+        propertyId.data = topic[3].data;
+        propertyId.length = (topic[count - 1].data + topic[count - 1].length) - propertyId.data;
+      }
+      WProperty* property = (propertyId.empty() ? nullptr : _mqttRouter->property(route, &propertyId));
+      if ((isState) && (body.empty())) {
+        // State request
+        if (propertyId.empty()) {
+          // Empty payload for topic 'properties' -> send device state
+          LOG->notice(F("Send complete device state..."));
+          _mqttSendDeviceState(device, true);
+        } else if (property != nullptr) {
+          if (property->isVisible(MQTT)) {
+            LOG->notice(F("Send state of property '%s'"), propertyId.data);
+            WStringStream* response = createResponseStream();
+            WJson* json = WCbor::create(response, _mqttPayloadFormat);
+            property->toJsonValue(json);
+            delete json;
+            // the state topic of a property is the requested topic
+            publishMqtt(ptopic, response, true);
+            delete response;
+          }
+        } else {
+          device->handleUnknownMqttCallback(true, ptopic, propertyId.data, (char*)"", 0);
+        }
+      } else if ((!isState) && (!body.empty())) {
+        // Set request
+        if (propertyId.empty()) {
+          // set all properties as one batch: settings are saved once at the end and
+          // the device state is sent once by the next loop
+          LOG->notice(F("Try to set several properties for device %s"), device->id());
+          WStringStream* rejected = nullptr;
+          auto onKeyValue = [this, route, &rejected](const char* id, const char* value) {
+            WMqttSegment key;
+            key.data = id;
+            key.length = strlen(id);
+            WProperty* property = _mqttRouter->property(route, &key);
+            // unknown, hidden or read only properties and values that can't be parsed are rejected
+            if ((property != nullptr) && (property->isVisible(MQTT)) && (!property->readOnly()) && (_mqttParse(property, value))) {
+              LOG->notice(F("Set property '%s' to value '%s' (mqtt request)"), id, value);
+            } else {
+              if (rejected == nullptr) {
+                rejected = new WStringStream(SIZE_MQTT_REJECTED);
               } else {
-                // Try to find property and set single value
-                WProperty* property = device->getPropertyById(topic.c_str());
-                if (property != nullptr) {
-                  if (property->isVisible(MQTT)) {
-                    // Set Property
-                    LOG->notice(F("Try to set property %s for device %s"), topic, device->id());
-                    if (!property->parse((char*)payload)) {
-                      LOG->notice(F("Property not updated."));
-                    } else {
-                      LOG->notice(F("Property updated."));
-                    }
-                  }
-                } else {
-                  device->handleUnknownMqttCallback(false, ptopic, topic, (char*)payload, length);
-                }
+                rejected->print(", ");
               }
+              rejected->print(id);
             }
+          };
+          SETTINGS->beginBatch();
+          if (_mqttPayloadFormat == PAYLOAD_CBOR) {
+            WCborParser::forEachKeyValue(payload, length, onKeyValue);
           } else {
-            // unknown, ask the device
-            // device->handleUnknownMqttCallback(ptopic, topic, payload,
-            // length);
+            WJsonParser::forEachKeyValue(body.data, body.length, onKeyValue);
+          }
+          SETTINGS->endBatch();
+          if (rejected != nullptr) {
+            notice(F("Rejected properties for device %s: %s"), device->id(), rejected->c_str());
+            delete rejected;
+          }
+        } else if (property != nullptr) {
+          if (property->isVisible(MQTT)) {
+            // Set Property
+            LOG->notice(F("Try to set property %s for device %s"), propertyId.data, device->id());
+            bool updated = false;
+            if (_mqttPayloadFormat == PAYLOAD_CBOR) {
+              WCborParser::forValue(payload, length, [property, &updated](const char* value) { updated = property->parse(value); });
+            } else {
+              WMqttString v(&body);
+              updated = property->parse(v.c_str());
+            }
+            if (!updated) {
+              LOG->notice(F("Property not updated."));
+            } else {
+              LOG->notice(F("Property updated."));
+            }
           }
-        } else if (deviceId.equals("webServer")) {
-          enableWebServer(String((char*)payload).equals(WC_TRUE));
+        } else {
+          WMqttString v(&body);
+          device->handleUnknownMqttCallback(false, ptopic, propertyId.data, v.c_str(), length);
         }
       }
+    } else if (topic[1].equals("webServer")) {
+      enableWebServer(body.equals(WC_TRUE));
     }
   }
 
-  bool _mqttReconnect() {
+  // parse() is false for an unchanged value too, that isn't a rejection
+  bool _mqttParse(WProperty* property, const char* value) {
+    if (property->parse(value)) return true;
+    WValue parsed = WValue::empty(property->value()->type());
+    return ((parsed.parse(value)) && (property->value()->equals(parsed)));
+  }
+
+  bool _mqttReconnect(unsigned long now) {
+    HEAP_TAG(HEAP_MQTT);
     if (this->isSupportingMqtt()) {
+      _updateMqttTopics();
       LOG->notice(F("Connect to MQTT server: %s; user: '%s'; password: '%s'; clientName: '%s'"),
                   mqttServer(), mqttUser(), mqttPassword(), _getClientName(true).c_str());
-      // Attempt to connect
-      _mqttClient->setServer(mqttServer(), String(mqttPort()).toInt());
+      // Attempt to connect, blocks up to MQTT_CONNECT_TIMEOUT
       bool connected = false;
       // Create last will message
       if (this->isLastWillEnabled()) {
-        String lastWillTopic = String(getIdx());
-        lastWillTopic.concat(SLASH);
+        const char* lastWillTopic = getIdx();
         WStringStream* lastWillMessage = createResponseStream();
-        WJson* json = new WJson(lastWillMessage);
+        WJson* json = WCbor::create(lastWillMessage, _mqttPayloadFormat);
         WDevice* device = _devices->getIf([this](WDevice* d) { return (d->isMainDevice()); });
         if (device != nullptr) {
-          lastWillTopic.concat(device->id());
-          lastWillTopic.concat(SLASH);
-          lastWillTopic.concat(mqttStateTopic());
+          lastWillTopic = _mqttTopics->getById(device->id())->state;
           json->beginObject();
           json->propertyString("idx", getIdx(), nullptr);
           json->propertyString("ip", getDeviceIp().toString().c_str(), nullptr);
@@ -753,23 +925,21 @@ class WNetwork {
           json->endObject();
         }
         delete json;
-        connected = (_mqttClient->connect(
-            _getClientName(true).c_str(),
-            mqttUser(),
-            mqttPassword(), lastWillTopic.c_str(), 0, true,
-            lastWillMessage->c_str()));
+        connected = _mqtt->connect(now, mqttServer(), String(mqttPort()).toInt(),
+                                   _getClientName(true).c_str(),
+                                   mqttUser(), mqttPassword(),
+                                   lastWillTopic, (const uint8_t*)lastWillMessage->c_str(), lastWillMessage->length());
         delete lastWillMessage;    
       } else {
-        connected = (_mqttClient->connect(
-            _getClientName(true).c_str(),
-            mqttUser(),
-            mqttPassword()));
+        connected = _mqtt->connect(now, mqttServer(), String(mqttPort()).toInt(),
+                                   _getClientName(true).c_str(),
+                                   mqttUser(), mqttPassword());
       }
 
       if (connected) {
         LOG->notice(F("Connected to MQTT server."));
-        //  Send device structure and status
-        _mqttClient->subscribe("devices/#");
+        //  Send device structure and status, messages are queued and sent by the next loops
+        _mqtt->client()->subscribe("devices/#");
         _devices->forEach([this](int index, WDevice* device, const char* id) {
           String topic("devices/");
           topic.concat(device->id());
@@ -777,21 +947,20 @@ class WNetwork {
           WJson* json = new WJson(response);
           json->beginObject();
           json->propertyString("url", "http://", getDeviceIp().toString().c_str(), "/things/", device->id(), nullptr);
-          json->propertyString("stateTopic", getIdx(), SLASH, device->id(), SLASH, mqttStateTopic(), nullptr);
-          json->propertyString("setTopic", getIdx(), SLASH, device->id(), SLASH, mqttSetTopic(), nullptr);
+          WMqttTopics* topics = _mqttTopics->getById(device->id());
+          json->propertyString("stateTopic", topics->state, nullptr);
+          json->propertyString("setTopic", topics->set, nullptr);
           json->endObject();
           delete json;
-          _mqttClient->publish(topic.c_str(), response->c_str(), false);
+          publishMqtt(topic.c_str(), response, false);
           delete response;
         });
-        _mqttClient->unsubscribe("devices/#");
+        _mqtt->client()->unsubscribe("devices/#");
         // Subscribe to device specific topic
-        _mqttClient->subscribe(String(String(getIdx()) + "/#").c_str());
+        _mqtt->client()->subscribe(String(String(getIdx()) + "/#").c_str());
         _notify(false);
         return true;
       } else {
-        LOG->notice(F("Connection to MQTT server failed, rc=%d"), _mqttClient->state());
-        this->startWebServer();
         _notify(false);
         return false;
       }
@@ -824,6 +993,7 @@ class WNetwork {
   }
 
   void _handleHttpEvent(AsyncWebServerRequest* request) {
+    HEAP_TAG(HEAP_WEB);
     LOG->debug(F("Simple http event handling"));
     if (_postResponse.operation == FO_NONE) {
       WList<WValue>* args = new WList<WValue>();
@@ -865,6 +1035,7 @@ class WNetwork {
   }
 
   void _handleHttpFinishEvent(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+    HEAP_TAG(HEAP_WEB);
     LOG->debug(F("Advanced http event handling"));
     WStringStream* ss = createResponseStream();
     for (size_t i = 0; i < len; i++) {
@@ -892,54 +1063,93 @@ class WNetwork {
     return result + "_" + chipId;
   }
 
+  // Multipart upload of the firmware page. A form sends no digest, so the image is NOT verified:
+  // only its completeness is checked. Verified updates use the PUT of OTA_PATH
   void _handleHttpProgressEvent(AsyncWebServerRequest* request, String filename, size_t index, uint8_t* data, size_t len, bool final) {
-    LOG->debug("handle update progress...");
     // Start firmwareUpdate
     _updateRunning = true;
     // Close existing MQTT connections
     this->disconnectMqtt();
-    // Start update
+    if (FIRMWARE_UPDATE == nullptr) FIRMWARE_UPDATE = new WFirmwareUpdate(new WUpdateTarget());
+    // Start update, the image of a multipart upload is smaller than the request
     if (!index) {
       LOG->notice(F("Update starting: %s"), filename.c_str());
-      size_t content_len = request->contentLength();
-      int cmd = U_FLASH;
-      (filename.indexOf("spiffs") > -1) ? U_PART : U_FLASH;
-#ifdef ARDUINO_ARCH_ESP32
-      if (filename.indexOf("spiffs") > -1 || filename.indexOf("littlefs") > -1) {
-        cmd = U_SPIFFS;  // Für Dateisystem-Updates
-      }
-
-      // Wichtig: Für ESP32 muss die Größe korrekt sein
-      if (!Update.begin(UPDATE_SIZE_UNKNOWN, cmd)) {
-        LOG->debug(F("Can't start update"));
-        Update.printError(Serial);
-      }
-#else
-      // ESP8266 Code
-      size_t content_len = request->contentLength();
-      int cmd = (filename.indexOf("spiffs") > -1) ? U_PART : U_FLASH;
-      Update.runAsync(true);
-      if (!Update.begin(content_len, cmd)) {
-        LOG->debug(F("Can't start update"));
-      }
-#endif
+      int command = (((filename.indexOf("spiffs") > -1) || (filename.indexOf("littlefs") > -1)) ? U_PART : U_FLASH);
+      FIRMWARE_UPDATE->begin(0, nullptr, command, request->contentLength());
     }
     // Upload running
-    if (len) {
-      if (Update.write(data, len) != len) {
-        LOG->debug(F("Can't upload file"));
-        Update.printError(Serial);
-      }
+    if ((len) && (!FIRMWARE_UPDATE->write(index, data, len))) {
+      FIRMWARE_UPDATE->abort("Can't write update");
     }
     // Upload finished
     if (final) {
-      if (!Update.end(true)) {
-        LOG->debug(F("Can't finish update"));
-        Update.printError(Serial);
+      FIRMWARE_UPDATE->finish();
+    }
+  }
+
+  void _handleFirmwareUploadBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+    if (FIRMWARE_UPDATE == nullptr) FIRMWARE_UPDATE = new WFirmwareUpdate(new WUpdateTarget());
+    if (index == 0) {
+      // "Content-Range: bytes <first>-<last>/<size>", without it the body is the whole image
+      unsigned long first = 0, last = 0, size = total;
+      if ((request->hasHeader(WC_CONTENT_RANGE)) &&
+          (sscanf(request->header(WC_CONTENT_RANGE).c_str(), "bytes %lu-%lu/%lu", &first, &last, &size) != 3)) {
+        _otaStatus = 400;
+        return;
       }
+      _otaFirst = first;
+      _otaStatus = 200;
+      if (first == 0) {
+        // the digest is mandatory, an image without it is never written
+        String sha256 = request->header(WC_X_SHA256);
+        uint8_t digest[SHA256_SIZE];
+        if (!WSha256::fromHex(sha256.c_str(), digest)) {
+          LOG->error(F("Update rejected, no valid X-Sha256 header"));
+          _otaStatus = 400;
+          return;
+        }
+        _updateRunning = true;
+        this->disconnectMqtt();
+        if (!FIRMWARE_UPDATE->begin(size, sha256.c_str(), U_FLASH)) _otaStatus = 500;
+      } else if ((!FIRMWARE_UPDATE->isRunning()) || (first > FIRMWARE_UPDATE->offset()) || (size != FIRMWARE_UPDATE->size())) {
+        // the client has to continue at the offset of the state response
+        _otaStatus = 416;
+      }
+    }
+    if (_otaStatus != 200) return;
+    if (!FIRMWARE_UPDATE->write(_otaFirst + index, data, len)) {
+      _otaStatus = (FIRMWARE_UPDATE->isRunning() ? 416 : 500);
+    } else if ((index + len == total) && (FIRMWARE_UPDATE->offset() == FIRMWARE_UPDATE->size())) {
+      if (!FIRMWARE_UPDATE->finish()) _otaStatus = 500;
+    }
+  }
+
+  void _handleFirmwareUpload(AsyncWebServerRequest* request) {
+    _sendFirmwareUpdateState(request, _otaStatus);
+    if ((FIRMWARE_UPDATE != nullptr) && (FIRMWARE_UPDATE->state() == OTA_VERIFIED)) {
+      SETTINGS->save();
+      this->restart();
+    } else if ((FIRMWARE_UPDATE == nullptr) || (!FIRMWARE_UPDATE->isRunning())) {
+      _updateRunning = false;
     }
   }
 
+  void _sendFirmwareUpdateState(AsyncWebServerRequest* request, int code) {
+    const static char* const states[] = {"idle", "running", "verified", "failed"};
+    AsyncResponseStream* response = request->beginResponseStream(APPLICATION_JSON);
+    response->setCode(code);
+    WJson json(response);
+    json.beginObject();
+    json.propertyString(WC_STATE, states[FIRMWARE_UPDATE != nullptr ? FIRMWARE_UPDATE->state() : OTA_IDLE], nullptr);
+    WValue offset((uint32_t)(FIRMWARE_UPDATE != nullptr ? FIRMWARE_UPDATE->offset() : 0));
+    json.propertyValue(WC_OFFSET, &offset);
+    WValue size((uint32_t)(FIRMWARE_UPDATE != nullptr ? FIRMWARE_UPDATE->size() : 0));
+    json.propertyValue(WC_SIZE, &size);
+    if ((FIRMWARE_UPDATE != nullptr) && (FIRMWARE_UPDATE->error() != nullptr)) json.propertyString(WC_ERROR, FIRMWARE_UPDATE->error(), nullptr);
+    json.endObject();
+    request->send(response);
+  }
+
   void _loadNetworkSettings() {
     _idx = SETTINGS->setNetworkString(WC_ID, _getClientName(true).c_str());
     _hostname = new char[strlen_P(_idx->asString()) + 1];
@@ -963,7 +1173,7 @@ class WNetwork {
       if (strcmp(getIdx(), "") == 0) {
         _idx->asString(_getClientName(true).c_str());
       }
-      if ((isSupportingMqtt()) && (_mqttClient != nullptr)) {
+      if ((isSupportingMqtt()) && (_mqtt != nullptr)) {
         this->disconnectMqtt();
       }
       LOG->debug(F("SSID: '%s'; MQTT enabled: %T; MQTT server: '%s'; MQTT port: %s; WebServer started: %T"),
@@ -980,24 +1190,34 @@ class WNetwork {
   }
 
   void _sendDevicesStructure(AsyncWebServerRequest* request) {
+    HEAP_TAG(HEAP_WEB);
     if (!isUpdateRunning()) {
       LOG->notice(F("Send description for all devices... "));
-      AsyncResponseStream* response = request->beginResponseStream(APPLICATION_JSON);
-      WJson* json = new WJson(response);
-      json->beginArray();
-      _devices->forEach([this, json](int index, WDevice* device, const char* id) {
-        if (device->isVisible(WEBTHING)) {
-          LOG->notice(F("Send description for device %s "), device->id());
-          device->toJsonStructure(json, "", WEBTHING);
+      // can be large, so it's sent in chunks
+      // step 0 opens the array, then one device per step
+      bool first = true;
+      WebChunkedResponse::send(request, APPLICATION_JSON, [this, first](Print* stream, uint16_t step) mutable {
+        if (step == 0) {
+          stream->print(WC_RBEGIN);
+          return true;
+        } else if (step > _devices->size()) {
+          stream->print(WC_REND);
+          return false;
         }
+        WDevice* device = _devices->get(step - 1);
+        if ((device != nullptr) && (device->isVisible(WEBTHING))) {
+          if (!first) stream->print(WC_COMMA);
+          first = false;
+          WJson json(stream);
+          device->toJsonStructure(&json, "", WEBTHING);
+        }
+        return true;
       });
-      json->endArray();
-      delete json;  // ← Hier fehlte das delete!
-      request->send(response);
     }
   }
 
   void _sendDeviceStructure(AsyncWebServerRequest* request, WDevice*& device) {
+    HEAP_TAG(HEAP_WEB);
     if (!isUpdateRunning()) {
       LOG->notice(F("Send description for device: %s"), device->id());
       AsyncResponseStream* response = request->beginResponseStream(APPLICATION_JSON);
@@ -1009,6 +1229,7 @@ class WNetwork {
   }
 
   void _sendDeviceValues(AsyncWebServerRequest* request, WDevice*& device) {
+    HEAP_TAG(HEAP_WEB);
     if (!isUpdateRunning()) {
       LOG->notice(F("Send all properties for device: "), device->id());
       AsyncResponseStream* response = request->beginResponseStream(APPLICATION_JSON);
@@ -1027,6 +1248,7 @@ class WNetwork {
   }
 
   void _getPropertyValue(AsyncWebServerRequest* request, WProperty* property, const char* propertyId) {
+    HEAP_TAG(HEAP_WEB);
     if (!isUpdateRunning()) {
       AsyncResponseStream* response =
           request->beginResponseStream(APPLICATION_JSON);
@@ -1041,6 +1263,7 @@ class WNetwork {
   }
 
   void _handleBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+    HEAP_TAG(HEAP_WEB);
     if (!isUpdateRunning()) {
       if ((total >= ESP_MAX_PUT_BODY_SIZE) || (index + len >= ESP_MAX_PUT_BODY_SIZE)) {
         return;  // cannot store this size..
@@ -1053,6 +1276,7 @@ class WNetwork {
   }
 
   void _setPropertyValue(AsyncWebServerRequest* request, WDevice* device) {
+    HEAP_TAG(HEAP_WEB);
     if (!isUpdateRunning()) {
       if (!_b_has_body_data) {
         request->send(422);
@@ -1121,6 +1345,15 @@ class WNetwork {
     }
   }
 
+  void _updateMqttTopics() {
+    _devices->forEach([this](int index, WDevice* device, const char* id) {
+      _mqttTopics->getById(device->id())->update(getIdx(), device->id(), mqttStateTopic(), mqttSetTopic());
+    });
+    // properties may have been registered after the device was added
+    _mqttRouter->build(_devices);
+    if (WEB_STATE) WEB_STATE->build(_devices);
+  }
+
   WDevice* _getDeviceById(const char* deviceId) {
     return _devices->getIf([deviceId](WDevice* d) { return (strcmp(d->id(), deviceId) == 0); });
   }
@@ -0,0 +1,164 @@
+#ifndef W_PROFILER_H
+#define W_PROFILER_H
+
+/*
+  Loop time profiler, enabled with build flag -DW_PROFILER.
+  Every profiled component gets a slot with count, min, avg, max and a
+  log2 histogram of microseconds, from which p99 is estimated.
+  Without the flag, all PROFILE_* macros compile to nothing.
+*/
+
+#ifdef W_PROFILER
+
+#include <Arduino.h>
+
+#include "WJson.h"
+
+#define PROFILE_SLOTS 32
+// bucket i counts durations < 2^i microseconds, the last one all above
+#define PROFILE_BUCKETS 20
+#define PROFILE_NO_SLOT 0xFF
+#define PROFILE_NAME_LENGTH 24
+#define PROFILE_PUBLISH_INTERVAL 60000
+
+struct WLoopStats {
+  const char* name;
+  byte index;
+  unsigned long count;
+  unsigned long long total;
+  unsigned long minimum;
+  unsigned long maximum;
+  uint16_t buckets[PROFILE_BUCKETS];
+
+  void reset() {
+    count = 0;
+    total = 0;
+    minimum = 0xFFFFFFFF;
+    maximum = 0;
+    memset(buckets, 0, sizeof(buckets));
+  }
+
+  void add(unsigned long us) {
+    count++;
+    total += us;
+    if (us < minimum) minimum = us;
+    if (us > maximum) maximum = us;
+    byte b = (us == 0 ? 0 : min(32 - __builtin_clz((uint32_t)us), PROFILE_BUCKETS - 1));
+    if (buckets[b] == 0xFFFF) {
+      // keep the distribution, halve all counts
+      for (byte i = 0; i < PROFILE_BUCKETS; i++) buckets[i] >>= 1;
+    }
+    buckets[b]++;
+  }
+
+  unsigned long avg() { return (count > 0 ? total / count : 0); }
+
+  // upper bound of the bucket that contains the percentile
+  unsigned long percentile(byte p) {
+    unsigned long sum = 0;
+    for (byte i = 0; i < PROFILE_BUCKETS; i++) sum += buckets[i];
+    unsigned long limit = (sum * p + 99) / 100;
+    unsigned long cumulated = 0;
+    for (byte i = 0; i < PROFILE_BUCKETS; i++) {
+      cumulated += buckets[i];
+      if ((cumulated >= limit) && (cumulated > 0)) return min((1UL << i), maximum);
+    }
+    return maximum;
+  }
+};
+
+class WProfiler {
+ public:
+  WProfiler() {
+    for (byte i = 0; i < PROFILE_SLOTS; i++) _slots[i].reset();
+  }
+
+  // Returns the slot for name/index, registers a new one if needed
+  byte slot(const char* name, byte index = PROFILE_NO_SLOT) {
+    for (byte i = 0; i < _size; i++) {
+      if ((_slots[i].name == name) && (_slots[i].index == index)) return i;
+    }
+    if (_size == PROFILE_SLOTS) return PROFILE_NO_SLOT;
+    _slots[_size].name = name;
+    _slots[_size].index = index;
+    return _size++;
+  }
+
+  void add(byte slot, unsigned long us) {
+    if (slot < _size) _slots[slot].add(us);
+  }
+
+  byte size() { return _size; }
+
+  WLoopStats* stats(byte slot) { return &_slots[slot]; }
+
+  void reset() {
+    for (byte i = 0; i < _size; i++) _slots[i].reset();
+  }
+
+  // name of a slot, e.g. 'switch.4'; the name may be in flash (PROGMEM)
+  static const char* name(WLoopStats* stats, char* buffer, size_t size) {
+    strncpy_P(buffer, stats->name, size);
+    buffer[size - 1] = '\0';
+    if (stats->index != PROFILE_NO_SLOT) {
+      size_t length = strlen(buffer);
+      snprintf(buffer + length, size - length, ".%d", stats->index);
+    }
+    return buffer;
+  }
+
+  void toJson(WJson* json) {
+    char buffer[PROFILE_NAME_LENGTH];
+    json->beginObject();
+    for (byte i = 0; i < _size; i++) {
+      WLoopStats* s = &_slots[i];
+      if (s->count == 0) continue;
+      json->beginObject(name(s, buffer, PROFILE_NAME_LENGTH));
+      WValue v((uint32_t)s->count);
+      json->propertyValue("n", &v);
+      v.asUnsignedLong(s->minimum);
+      json->propertyValue("min", &v);
+      v.asUnsignedLong(s->avg());
+      json->propertyValue("avg", &v);
+      v.asUnsignedLong(s->maximum);
+      json->propertyValue("max", &v);
+      v.asUnsignedLong(s->percentile(99));
+      json->propertyValue("p99", &v);
+      json->endObject();
+    }
+    json->endObject();
+  }
+
+ private:
+  WLoopStats _slots[PROFILE_SLOTS];
+  byte _size = 0;
+};
+
+WProfiler* PROFILER = new WProfiler();
+
+// Measures the time until end of the enclosing scope
+class WProfileScope {
+ public:
+  WProfileScope(byte slot) {
+    _slot = slot;
+    _start = micros();
+  }
+
+  ~WProfileScope() { PROFILER->add(_slot, micros() - _start); }
+
+ private:
+  byte _slot;
+  unsigned long _start;
+};
+
+#define PROFILE_SLOT(name, index) PROFILER->slot(name, index)
+#define PROFILE_SCOPE(slot) WProfileScope _profileScope(slot)
+
+#else
+
+#define PROFILE_SLOT(name, index) 0
+#define PROFILE_SCOPE(slot)
+
+#endif
+
+#endif
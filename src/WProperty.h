@@ -319,8 +319,12 @@ class WProperty {
     } else {
       _multipleOf->asDouble(multipleOf); 
     }
+    _precision = WValue::precisionOf(multipleOf);
   }  
 
+  // decimals used for double output, derived from multipleOf
+  byte precision() { return _precision; }
+
   virtual void toJsonValue(WJson* json, const char* memberName = nullptr) {
     _requestValue();
     switch (_value->type()) {
@@ -331,7 +335,7 @@ class WProperty {
           json->onlyString(_value->asString());
         break;
       default:
-        json->propertyValue(memberName, _value);
+        json->propertyValue(memberName, _value, _precision);
         break;
     }
     _requested = true;
@@ -339,7 +343,7 @@ class WProperty {
 
   virtual void toString(Print* stream) {
     _requestValue();
-    _value->toString(stream);
+    WValue::toString(stream, _value, _precision);
     if (_unit) {
       stream->print(_unit);
     }
@@ -382,7 +386,7 @@ class WProperty {
     }
     // multipleOf
     if (_multipleOf != nullptr) {
-      json->propertyValue("multipleOf", _multipleOf);
+      json->propertyValue("multipleOf", _multipleOf, _precision);
     }
     // enum
     if (this->hasEnums()) {
@@ -393,7 +397,7 @@ class WProperty {
             json->string(propE->asString(), nullptr);
             break;
           default:
-            json->pValue(propE);
+            json->pValue(propE, _precision);
             break;
         }
       });
@@ -569,6 +573,7 @@ class WProperty {
   WValue _readOnly;
   char* _unit = nullptr;
   WValue* _multipleOf = nullptr;
+  byte _precision = DOUBLE_DEFAULT_PRECISION;
   std::list<TOnPropertyChange> _listeners;
   TOnPropertyChange _onValueRequest;
   TOnPropertyChange _deviceNotification;
@@ -649,8 +654,8 @@ class WRangeProperty : public WProperty {
   }
 
   void _toJsonStructureAdditionalParameters(WJson* json) {
-    json->propertyValue("minimum", &_min);
-    json->propertyValue("maximum", &_max);
+    json->propertyValue("minimum", &_min, precision());
+    json->propertyValue("maximum", &_max, precision());
   }
 
  protected:
@@ -0,0 +1,193 @@
+#ifndef W_SCHEDULER_H
+#define W_SCHEDULER_H
+
+#include <Arduino.h>
+
+#include "WProfiler.h"
+
+#define SCHEDULER_MAX_IDLE 1000
+#define SCHEDULER_INITIAL_CAPACITY 4
+#define SCHEDULER_NOT_QUEUED 0xFFFF
+
+class WScheduler;
+
+/*
+  A component with a loop that is called only when due.
+  After each loop, nextLoop(now) tells when the next call is needed;
+  the default 'now' means every loop. wakeUp() makes it due with the next
+  loop of the scheduler, e.g. after a state change from outside the loop.
+  It only sets flags, so it may be called from another task (e.g. a web
+  request on the ESP32), the heap is only changed by the loop task.
+*/
+class WSchedulable {
+ public:
+  virtual void loop(unsigned long now) = 0;
+
+  virtual unsigned long nextLoop(unsigned long now) { return now; }
+
+  void wakeUp();
+
+  unsigned long due() { return _due; }
+
+#ifdef W_PROFILER
+  void profileSlot(byte slot) { _profileSlot = slot; }
+#endif
+
+ private:
+  friend class WScheduler;
+  WScheduler* _scheduler = nullptr;
+  unsigned long _due = 0;
+  uint16_t _heapIndex = 0;
+  volatile bool _wokenUp = false;
+#ifdef W_PROFILER
+  byte _profileSlot = PROFILE_NO_SLOT;
+#endif
+};
+
+/*
+  Min-heap of WSchedulables ordered by due time (millis, overflow safe).
+  loop(now) only calls the components that are due.
+*/
+class WScheduler {
+ public:
+  ~WScheduler() {
+    if (_heap) delete[] _heap;
+    if (_ready) delete[] _ready;
+  }
+
+  void add(WSchedulable* item) {
+    if (_size == _capacity) {
+      uint16_t capacity = _capacity;
+      _capacity = (_capacity == 0 ? SCHEDULER_INITIAL_CAPACITY : _capacity * 2);
+      WSchedulable** heap = new WSchedulable*[_capacity];
+      WSchedulable** ready = new WSchedulable*[_capacity];
+      // also called from a running loop(), its ready items are kept
+      for (uint16_t i = 0; i < capacity; i++) {
+        heap[i] = _heap[i];
+        ready[i] = _ready[i];
+      }
+      if (_heap) delete[] _heap;
+      if (_ready) delete[] _ready;
+      _heap = heap;
+      _ready = ready;
+    }
+    item->_scheduler = this;
+    _push(item, millis());
+  }
+
+  void loop(unsigned long now) {
+    if (_wokenUp) _dueWokenUp(now);
+    // all due items are taken out first, an item that is due again at 'now' runs with the next loop
+    uint16_t count = 0;
+    while ((_size > 0) && (!_before(now, _heap[0]->_due))) {
+      _ready[count++] = _pop();
+    }
+    for (uint16_t i = 0; i < count; i++) {
+      WSchedulable* item = _ready[i];
+      item->_wokenUp = false;
+      {
+        PROFILE_SCOPE(item->_profileSlot);
+        item->loop(now);
+      }
+      unsigned long next = item->nextLoop(now);
+      // at least once per SCHEDULER_MAX_IDLE
+      if (_before(now + SCHEDULER_MAX_IDLE, next)) next = now + SCHEDULER_MAX_IDLE;
+      // woken up while running, runs again at once
+      _push(item, ((item->_wokenUp) || (_before(next, now)) ? now : next));
+    }
+  }
+
+  bool empty() { return (_size == 0); }
+
+  // due time of the earliest component; only valid if not empty
+  unsigned long nextDue() { return _heap[0]->_due; }
+
+  // milliseconds until the next component is due, 0 if one is due now
+  unsigned long timeUntilNextDue(unsigned long now) {
+    if (_size == 0) return SCHEDULER_MAX_IDLE;
+    return (_before(now, _heap[0]->_due) ? _heap[0]->_due - now : 0);
+  }
+
+ private:
+  WSchedulable** _heap = nullptr;
+  // due items of the running loop()
+  WSchedulable** _ready = nullptr;
+  uint16_t _size = 0;
+  uint16_t _capacity = 0;
+  // set by wakeUp() of any item, possibly from another task
+  volatile bool _wokenUp = false;
+
+  friend class WSchedulable;
+
+  // Makes the woken up items of the heap due now and restores the heap order
+  void _dueWokenUp(unsigned long now) {
+    _wokenUp = false;
+    bool changed = false;
+    for (uint16_t i = 0; i < _size; i++) {
+      if (_heap[i]->_wokenUp) {
+        _heap[i]->_wokenUp = false;
+        _heap[i]->_due = now;
+        changed = true;
+      }
+    }
+    if (changed) {
+      for (uint16_t i = _size / 2; i > 0; i--) _siftDown(i - 1);
+    }
+  }
+
+  static bool _before(unsigned long a, unsigned long b) { return ((long)(a - b) < 0); }
+
+  void _push(WSchedulable* item, unsigned long due) {
+    item->_due = due;
+    item->_heapIndex = _size;
+    _heap[_size++] = item;
+    _siftUp(item->_heapIndex);
+  }
+
+  WSchedulable* _pop() {
+    WSchedulable* item = _heap[0];
+    _size--;
+    if (_size > 0) {
+      _heap[0] = _heap[_size];
+      _heap[0]->_heapIndex = 0;
+      _siftDown(0);
+    }
+    item->_heapIndex = SCHEDULER_NOT_QUEUED;
+    return item;
+  }
+
+  void _swap(uint16_t i, uint16_t j) {
+    WSchedulable* t = _heap[i];
+    _heap[i] = _heap[j];
+    _heap[j] = t;
+    _heap[i]->_heapIndex = i;
+    _heap[j]->_heapIndex = j;
+  }
+
+  void _siftUp(uint16_t i) {
+    while ((i > 0) && (_before(_heap[i]->_due, _heap[(i - 1) / 2]->_due))) {
+      _swap(i, (i - 1) / 2);
+      i = (i - 1) / 2;
+    }
+  }
+
+  void _siftDown(uint16_t i) {
+    while (true) {
+      uint16_t smallest = i;
+      uint16_t l = 2 * i + 1;
+      uint16_t r = l + 1;
+      if ((l < _size) && (_before(_heap[l]->_due, _heap[smallest]->_due))) smallest = l;
+      if ((r < _size) && (_before(_heap[r]->_due, _heap[smallest]->_due))) smallest = r;
+      if (smallest == i) return;
+      _swap(i, smallest);
+      i = smallest;
+    }
+  }
+};
+
+inline void WSchedulable::wakeUp() {
+  _wokenUp = true;
+  if (_scheduler != nullptr) _scheduler->_wokenUp = true;
+}
+
+#endif
@@ -29,7 +29,23 @@ class WSettings {
 
   bool isReadingFirstTime() { return _readingFirstTime; }
 
-  void save() { _saveEEPROM(FLAG_OPTIONS_NETWORK); }
+  void save() {
+    if (_batchDepth > 0) {
+      _batchSaveRequested = true;
+    } else {
+      _saveEEPROM(FLAG_OPTIONS_NETWORK);
+    }
+  }
+
+  // Calls of save() between beginBatch() and endBatch() are written once at endBatch()
+  void beginBatch() { _batchDepth++; }
+
+  void endBatch() {
+    if ((_batchDepth > 0) && (--_batchDepth == 0) && (_batchSaveRequested)) {
+      _batchSaveRequested = false;
+      save();
+    }
+  }
 
   void forceAPNextStart() { _saveEEPROM(FLAG_OPTIONS_NETWORK_FORCE_AP); }
 
@@ -67,6 +83,7 @@ class WSettings {
   }
 
   void add(WValue* value, int index, const char* id, bool networkSetting) {
+    HEAP_TAG(HEAP_SETTINGS);
     if (!_items->exists(value)) {
       _items->insert(value, index, id);
       // read stored values
@@ -163,6 +180,7 @@ class WSettings {
   }
 
   WValue* setByte(const char* id, byte b, byte max = 0xFF) {
+    HEAP_TAG(HEAP_SETTINGS);
     WValue* value = _items->getById(id);
     if (value == nullptr) {
       value = new WValue(b);
@@ -182,6 +200,7 @@ class WSettings {
   }
 
   WValue* setInteger(const char* id, int i) {
+    HEAP_TAG(HEAP_SETTINGS);
     WValue* value = _items->getById(id);
     if (value == nullptr) {
       value = new WValue(i);
@@ -198,6 +217,7 @@ class WSettings {
   }
 
   WValue* setShort(const char* id, short s) {
+    HEAP_TAG(HEAP_SETTINGS);
     WValue* value = _items->getById(id);
     if (value == nullptr) {
       value = new WValue(s);
@@ -214,6 +234,7 @@ class WSettings {
   }
 
   WValue* setUnsignedLong(const char* id, unsigned long ul) {
+    HEAP_TAG(HEAP_SETTINGS);
     WValue* value = _items->getById(id);
     if (value == nullptr) {
       value = new WValue(ul);
@@ -230,6 +251,7 @@ class WSettings {
   }
 
   WValue* setDouble(const char* id, double d) {
+    HEAP_TAG(HEAP_SETTINGS);
     WValue* value = _items->getById(id);
     if (value == nullptr) {
       value = new WValue(d);
@@ -254,6 +276,7 @@ class WSettings {
   }
 
   WValue* setByteArray(const char* id, byte length, const byte* ba) {
+    HEAP_TAG(HEAP_SETTINGS);
     WValue* value = _items->getById(id);
     if (value == nullptr) {
       value = new WValue(length, ba);      
@@ -292,6 +315,7 @@ class WSettings {
 
  protected:
   WValue* setBoolean(const char* id, bool b, bool networkSetting) {
+    HEAP_TAG(HEAP_SETTINGS);
     WValue* value = _items->getById(id);
     if (value == nullptr) {
       value = new WValue((bool) b);
@@ -302,7 +326,8 @@ class WSettings {
     return value;
   }
 
-  WValue* setString(const char* id, const char* s, bool networkSetting) {        
+  WValue* setString(const char* id, const char* s, bool networkSetting) {
+    HEAP_TAG(HEAP_SETTINGS);
     WValue* value = _items->getById(id);
     if (value == nullptr) {
       value = new WValue(s);
@@ -356,6 +381,8 @@ class WSettings {
 
  private:
   bool _existsSettingsApplication;
+  byte _batchDepth = 0;
+  bool _batchSaveRequested = false;
   int _networkByte;
   WList<WValue>* _items;
   int _address;
@@ -0,0 +1,97 @@
+#ifndef W_SHA256_H
+#define W_SHA256_H
+
+#include <Arduino.h>
+#ifdef ARDUINO_ARCH_ESP8266
+#include <bearssl/bearssl_hash.h>
+#elif ARDUINO_ARCH_ESP32
+#include <mbedtls/sha256.h>
+#include <mbedtls/version.h>
+#endif
+
+#define SHA256_SIZE 32
+#define SHA256_HEX_LENGTH (SHA256_SIZE * 2)
+
+/*
+  Incremental SHA-256, for data that arrives in pieces, e.g. a firmware
+  upload. Uses the hash of the core's TLS library: BearSSL on ESP8266,
+  mbedTLS on ESP32 (hardware accelerated there).
+*/
+class WSha256 {
+ public:
+  WSha256() {
+#ifdef ARDUINO_ARCH_ESP32
+    mbedtls_sha256_init(&_context);
+#endif
+    reset();
+  }
+
+  ~WSha256() {
+#ifdef ARDUINO_ARCH_ESP32
+    mbedtls_sha256_free(&_context);
+#endif
+  }
+
+  void reset() {
+#ifdef ARDUINO_ARCH_ESP8266
+    br_sha256_init(&_context);
+#elif MBEDTLS_VERSION_NUMBER >= 0x03000000
+    mbedtls_sha256_starts(&_context, 0);
+#else
+    mbedtls_sha256_starts_ret(&_context, 0);
+#endif
+  }
+
+  void update(const uint8_t* data, size_t length) {
+#ifdef ARDUINO_ARCH_ESP8266
+    br_sha256_update(&_context, data, length);
+#elif MBEDTLS_VERSION_NUMBER >= 0x03000000
+    mbedtls_sha256_update(&_context, data, length);
+#else
+    mbedtls_sha256_update_ret(&_context, data, length);
+#endif
+  }
+
+  // Digest of all data since reset
+  void finish(uint8_t* digest) {
+#ifdef ARDUINO_ARCH_ESP8266
+    br_sha256_out(&_context, digest);
+#elif MBEDTLS_VERSION_NUMBER >= 0x03000000
+    mbedtls_sha256_finish(&_context, digest);
+#else
+    mbedtls_sha256_finish_ret(&_context, digest);
+#endif
+  }
+
+  // Lower case hex of digest to text of size SHA256_HEX_LENGTH + 1
+  static void toHex(const uint8_t* digest, char* text) {
+    for (byte i = 0; i < SHA256_SIZE; i++) sprintf(text + 2 * i, "%02x", digest[i]);
+  }
+
+  // false, if text isn't a hex digest
+  static bool fromHex(const char* text, uint8_t* digest) {
+    if ((text == nullptr) || (strlen(text) != SHA256_HEX_LENGTH)) return false;
+    for (byte i = 0; i < SHA256_HEX_LENGTH; i++) {
+      char c = tolower(text[i]);
+      byte v;
+      if ((c >= '0') && (c <= '9')) {
+        v = c - '0';
+      } else if ((c >= 'a') && (c <= 'f')) {
+        v = c - 'a' + 10;
+      } else {
+        return false;
+      }
+      digest[i / 2] = (i % 2 == 0 ? v << 4 : digest[i / 2] | v);
+    }
+    return true;
+  }
+
+ private:
+#ifdef ARDUINO_ARCH_ESP8266
+  br_sha256_context _context;
+#else
+  mbedtls_sha256_context _context;
+#endif
+};
+
+#endif
@@ -3,6 +3,9 @@
 
 #include "WStringStream.h"
 
+#define DOUBLE_DEFAULT_PRECISION 2
+#define DOUBLE_MAX_PRECISION 9
+
 enum class WDataType {
   BOOLEAN,
   DOUBLE,
@@ -518,19 +521,7 @@ struct WValue {
     va_list arg;
     va_start(arg, text);
     while (text) {
-      int index = 0;
-      while (text[index] != '\0') {
-        switch (text[index]) {
-          case '\n': {
-            stream->print("\\n");
-            break;
-          }
-          default:
-            stream->print((char)text[index]);
-        }
-        index++;
-      }
-      // stream->printf_P(text);
+      stream->print(text);
       text = va_arg(arg, const char*);
     }
     va_end(arg);
@@ -540,7 +531,7 @@ struct WValue {
     stream->print(WC_RBEGIN);
     for (byte i = 0; i < length; i++) {
       if (i != 0) stream->print(WC_COMMA);
-      stream->print(value[firstValueIsLength ? i + 1 : i], DEC);
+      numberUnsigned(stream, value[firstValueIsLength ? i + 1 : i]);
     }
     stream->print(WC_REND);
   }
@@ -549,28 +540,94 @@ struct WValue {
     stream->print(value ? WC_TRUE : WC_FALSE);
   }  
 
-  static void toString(Print* stream, WValue* value) {
+  // Writes the digits into a stack buffer and emits them with a single write
+  static void numberUnsigned(Print* stream, unsigned long value) {
+    char buffer[24];
+    char* end = &buffer[sizeof(buffer)];
+    char* p = _formatUnsigned(end, value);
+    stream->write((const uint8_t*)p, end - p);
+  }
+
+  static void numberInt(Print* stream, long value) {
+    char buffer[24];
+    char* end = &buffer[sizeof(buffer)];
+    char* p = _formatUnsigned(end, (value < 0 ? 0UL - (unsigned long)value : (unsigned long)value));
+    if (value < 0) *--p = '-';
+    stream->write((const uint8_t*)p, end - p);
+  }
+
+  // Fixed-point output with exactly 'precision' decimals (rounded half up)
+  static void numberDouble(Print* stream, double value, byte precision = DOUBLE_DEFAULT_PRECISION) {
+    if (isnan(value)) {
+      stream->print(F("nan"));
+      return;
+    }
+    if (isinf(value)) {
+      stream->print(value > 0 ? F("inf") : F("-inf"));
+      return;
+    }
+    static const uint32_t POW10[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+    if (precision > DOUBLE_MAX_PRECISION) precision = DOUBLE_MAX_PRECISION;
+    bool negative = (value < 0.0);
+    if (negative) value = -value;
+    double scaled = value * POW10[precision] + 0.5;
+    if (scaled >= 4294967295.0) {
+      // out of fixed-point range, let Print handle it
+      stream->print(negative ? -value : value, precision);
+      return;
+    }
+    uint32_t fixed = (uint32_t)scaled;
+    uint32_t fraction = fixed % POW10[precision];
+    char buffer[24];
+    char* end = &buffer[sizeof(buffer)];
+    char* p = end;
+    if (precision > 0) {
+      for (byte i = 0; i < precision; i++) {
+        *--p = '0' + (fraction % 10);
+        fraction /= 10;
+      }
+      *--p = '.';
+    }
+    p = _formatUnsigned(p, fixed / POW10[precision]);
+    if ((negative) && (fixed != 0)) *--p = '-';
+    stream->write((const uint8_t*)p, end - p);
+  }
+
+  // Number of decimals needed to represent multiples of 'multipleOf', e.g. 0.5 -> 1, 0.01 -> 2, 5 -> 0
+  static byte precisionOf(double multipleOf) {
+    if (multipleOf < 0.0) multipleOf = -multipleOf;
+    double scaled = multipleOf;
+    for (byte precision = 0; precision < DOUBLE_MAX_PRECISION; precision++) {
+      if (isDoubleEqual(scaled, round(scaled), 0.000001)) {
+        return precision;
+      }
+      scaled = scaled * 10;
+    }
+    return DOUBLE_MAX_PRECISION;
+  }
+
+  static void toString(Print* stream, WValue* value, byte precision = DOUBLE_DEFAULT_PRECISION) {
     switch (value->type()) {
       case WDataType::BOOLEAN:        
         boolToString(stream, value->asBool());
         break;
       case WDataType::DOUBLE:
-        stream->print(value->asDouble());
+        numberDouble(stream, value->asDouble(), precision);
         break;
       case WDataType::INTEGER:
-        stream->print(value->asInt(), DEC);
+        numberInt(stream, value->asInt());
         break;
       case WDataType::SHORT:
-      stream->print(value->asShort(), DEC);
+        numberInt(stream, value->asShort());
         break;
       case WDataType::UNSIGNED_SHORT:
-        stream->print(value->asUnsignedShort(), DEC);
+        numberUnsigned(stream, value->asUnsignedShort());
         break;
       case WDataType::UNSIGNED_LONG:
-        stream->print(value->asUnsignedLong(), DEC);
+        numberUnsigned(stream, value->asUnsignedLong());
         break;
       case WDataType::BYTE:
-      stream->print(value->asByte(), DEC);
+        numberUnsigned(stream, value->asByte());
         break;
       case WDataType::STRING:
         WValue::string(stream, value->asString(), nullptr);
@@ -605,6 +662,16 @@ struct WValue {
     byte* _asByteArray;
     WList<WValue>* _asList;
   };
+
+  // Fills digits backwards, ending at 'end'; returns pointer to the first digit
+  static char* _formatUnsigned(char* end, unsigned long value) {
+    char* p = end;
+    do {
+      *--p = '0' + (value % 10);
+      value /= 10;
+    } while (value != 0);
+    return p;
+  }
 };
 
 #endif
\ No newline at end of file
@@ -2,11 +2,14 @@
 #define WNetworkPages_h
 
 #include "WebApp.h"
+#include "../WFirmwareUpdate.h"
+#include "../WProfiler.h"
 
 class WRootPage : public WebPage {
  public:
   WRootPage(WList<WebPageItem>* customPages) : WebPage() {
     _customPages = customPages;
+    cacheable(true);
   }
 
   virtual ~WRootPage() {
@@ -70,6 +73,7 @@ class WNetworkPage : public WebPage {
 class WResetPage : public WebPage {
  public:
   WResetPage(WNetwork* network) : WebPage() {
+    cacheable(true);
   }
 
   virtual ~WResetPage() {
@@ -127,6 +131,10 @@ class WRestartPage : public WebPage {
 
 class WFirmwarePage : public WebPage {
  public:
+  WFirmwarePage() : WebPage() {
+    cacheable(true);
+  }
+
   virtual void createControls(WebControl* parentNode) {
     if (ESP.getSketchSize() < ESP.getFreeSketchSpace() / 2) {
       WebControl* form = new WebForm(WC_FIRMWARE, nullptr);
@@ -145,10 +153,12 @@ class WFirmwarePage : public WebPage {
   virtual WFormResponse submitForm(WList<WValue>* args) {
     LOG->debug("Update finished.");
     SETTINGS->save();
-    if (Update.hasError()) {
-      LOG->debug("Error %s", Update.errorString());
+    // only a complete image is bootable, see WFirmwareUpdate
+    bool success = ((FIRMWARE_UPDATE != nullptr) && (FIRMWARE_UPDATE->state() == OTA_VERIFIED));
+    if ((!success) && (FIRMWARE_UPDATE != nullptr) && (FIRMWARE_UPDATE->error() != nullptr)) {
+      LOG->debug("Error %s", FIRMWARE_UPDATE->error());
     }
-    return WFormResponse(FO_RESTART, (Update.hasError() ? PSTR("Some error during update") : PSTR("Update successful")));
+    return WFormResponse(FO_RESTART, (success ? PSTR("Update successful") : PSTR("Some error during update")));
   }
 };
 
@@ -183,6 +193,18 @@ class WInfoPage : public WebPage {
     _datas->add(new WValue(ESP.getFreeHeap()), PSTR("Free heap size"));
 #ifdef ARDUINO_ARCH_ESP8266
     _datas->add(new WValue(ESP.getMaxFreeBlockSize()), PSTR("Largest heap block"));
+#endif
+#ifdef W_HEAP_TRACKING
+    _datas->add(new WValue((uint32_t)WHeapTracker::allocations()), PSTR("Allocations"));
+    char name[12];
+    char label[32];
+    char data[24];
+    for (byte i = 0; i < HEAP_TAG_COUNT; i++) {
+      WHeapStats* stats = WHeapTracker::stats(i);
+      snprintf(label, sizeof(label), "Heap %s (now / peak)", WHeapTracker::name(i, name, sizeof(name)));
+      snprintf(data, sizeof(data), "%lu / %lu", (unsigned long)stats->bytes, (unsigned long)stats->peakBytes);
+      _datas->add(new WValue(data), label);
+    }
 #endif
     _datas->add(new WValue(_running) /*->unit(PSTR(" minutes"))*/, PSTR("Running since"));
 
@@ -257,4 +279,53 @@ class WInfoPage : public WebPage {
   WList<WValue>* _datas;
 };
 
+#ifdef W_PROFILER
+class WProfilerPage : public WebPage {
+ public:
+  WProfilerPage() : WebPage() {
+    _datas = new WList<WLoopStats>();
+  }
+
+  virtual ~WProfilerPage() {
+    delete _datas;
+  }
+
+  virtual void createControls(WebControl* parentNode) {
+    WebControl* div = new WebControl(WC_DIV, WC_CLASS, WC_WHITE_BOX, nullptr);
+    parentNode->add(div);
+    // snapshot, so all rows show the same measuring window
+    char buffer[PROFILE_NAME_LENGTH];
+    for (byte i = 0; i < PROFILER->size(); i++) {
+      WLoopStats* stats = PROFILER->stats(i);
+      _datas->add(new WLoopStats(*stats), WProfiler::name(stats, buffer, PROFILE_NAME_LENGTH));
+    }
+    div->add((new WebTable<WLoopStats>(_datas))->onPrintHeaderRow([this](Print* stream, int index, WLoopStats* item, const char* id) {
+      WebTable<WLoopStats>::headerCell(stream, PSTR("Loop"));
+      WebTable<WLoopStats>::headerCell(stream, PSTR("Count"));
+      WebTable<WLoopStats>::headerCell(stream, PSTR("Min"));
+      WebTable<WLoopStats>::headerCell(stream, PSTR("Avg"));
+      WebTable<WLoopStats>::headerCell(stream, PSTR("Max"));
+      WebTable<WLoopStats>::headerCell(stream, PSTR("p99"));
+    })->onPrintRow([this](Print* stream, int index, WLoopStats* item, const char* id) {
+      WebTable<WLoopStats>::headerCell(stream, id);
+      _dataCell(stream, item->count);
+      _dataCell(stream, (item->count > 0 ? item->minimum : 0));
+      _dataCell(stream, item->avg());
+      _dataCell(stream, item->maximum);
+      _dataCell(stream, item->percentile(99));
+    }));
+    div->add(new WebDiv((new WebButton(WC_BACK_TO_MAINMENU))->onClickNavigateTo(WC_CONFIG)));
+  }
+
+ private:
+  WList<WLoopStats>* _datas;
+
+  static void _dataCell(Print* stream, unsigned long value) {
+    char buffer[12];
+    snprintf(buffer, sizeof(buffer), "%lu", value);
+    WebTable<WLoopStats>::dataCell(stream, buffer);
+  }
+};
+#endif
+
 #endif
\ No newline at end of file
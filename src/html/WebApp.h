@@ -2,7 +2,10 @@
 #define W_WEBAPP_H
 
 #include "WebAppSockets.h"
+#include "WebChunkedResponse.h"
 #include "WebPage.h"
+#include "WebPageCache.h"
+#include "WebStatePush.h"
 #include "WebSocketsServer.h"
 
 //4096 crashes with PSRAM
@@ -15,10 +18,15 @@ struct WebPageItem {
     this->showInMainMenu = showInMainMenu;
   }
 
+  ~WebPageItem() {
+    if (cache) delete cache;
+  }
+
   WebPageInitializer initializer;
   const char* title;
   bool showInMainMenu;
   WebPage* instance = nullptr;
+  WebPageCache* cache = nullptr;
   unsigned long lastAlive = 0;
 };
 
@@ -34,22 +42,32 @@ class WebApp {
       switch (type) {
         case WStype_DISCONNECTED: {
           LOG->notice(F("WebSocket [%d] disconnected"), num);
+          WebAppSockets::connected(num, false);
+          if (WEB_STATE) WEB_STATE->subscribe(num, false);
           //_sessions->removeIf([clientId](WssSessionDetail *detail) { return (detail->client->id() == clientId); });
           break;
         }
         case WStype_CONNECTED: {
           IPAddress ip = WEB_SOCKETS->remoteIP(num);
           LOG->notice(F("WebSocket [%d] connected from %d.%d.%d.%d"), num, ip[0], ip[1], ip[2], ip[3]);
+          WebAppSockets::connected(num, true);
+          break;
+        }
+        case WStype_BIN: {
+          if ((WEB_STATE == nullptr) || (!WEB_STATE->handleFrame(num, payload, length))) {
+            LOG->debug(F("[%d] unknown binary frame, %d bytes"), num, length);
+          }
           break;
         }
         case WStype_TEXT: {
+          HEAP_TAG(HEAP_WEB);
           LOG->notice(F("[%d] get Text: %s"), num, (const char*)payload);
           WList<WValue>* args = WJsonParser::asMap((const char*)payload);
           WValue* event = args->getById(WC_EVENT);
           if ((args != nullptr) && (event != nullptr)) {
             WValue* form = args->getById(WC_FORM);
             if (form != nullptr) {
-              WebPageItem* pi = _webPages->getById(form->asString());
+              WebPageItem* pi = _pageIndex->get(form->asString());
               if (pi != nullptr) {
                 if (event->equals(WC_PING)) {
                   if (pi != nullptr) pi->lastAlive = millis();
@@ -117,6 +135,7 @@ class WebApp {
   }
 
   ~WebApp() {
+    delete _pageIndex;
     WEB_SOCKETS->close();
     delete WEB_SOCKETS;
     WEB_SOCKETS = nullptr;    
@@ -127,7 +146,22 @@ class WebApp {
   WList<WebPageItem>* webPages() { return _webPages; }
 
   void addWebPage(const char* id, WebPageInitializer initializer, const char* title, bool showInMainMenu = true) {
-    _webPages->add(new WebPageItem(initializer, title, showInMainMenu), id);
+    WebPageItem* pi = new WebPageItem(initializer, title, showInMainMenu);
+    _webPages->add(pi, id);
+    // keyed by the id copy of the list
+    _pageIndex->put(_webPages->getId(_webPages->size() - 1), pi);
+    // the main menu has changed
+    invalidateCache();
+  }
+
+  // Cached pages and the resource bundle are rendered again at their next request
+  void invalidateCache() {
+    _webPages->forEach([](int index, WebPageItem* pageItem, const char* id) {
+      if (pageItem->cache) delete pageItem->cache;
+      pageItem->cache = nullptr;
+    });
+    if (WEB_RESOURCES) delete WEB_RESOURCES;
+    WEB_RESOURCES = nullptr;
   }
 
   void webSocketBroadcast(const char* payload) {
@@ -136,10 +170,12 @@ class WebApp {
 
   void loop(unsigned long now) {
     WEB_SOCKETS->loop();
+    WebAppSockets::loop();
+    if (WEB_STATE) WEB_STATE->loop(now);
     if ((_lastPing == 0) || (now - _lastPing > 10000)) {
       _lastPing = now;
       LOG->debug("Ping  %d (Memory Free: %u  Min: %u  Max: %u)", now, ESP.getFreeHeap(), ESP.getMinFreeHeap(), ESP.getMaxAllocHeap());
-      WebAppSockets::sendMessage(WC_PING, nullptr, nullptr);
+      WebAppSockets::sendMessage(WC_PING, nullptr, nullptr, true);
       _cleanUpDeadSessions();
     }
   }
@@ -149,6 +185,8 @@ class WebApp {
 
   void bindWebServerCalls(AsyncWebServer* webServer) {
     _webPages->forEach([this, webServer](int index, WebPageItem* pageItem, const char* id) { _bind(webServer, pageItem, id); });
+    // matches all urls below the path too
+    webServer->on(WEB_RESOURCE_PATH, HTTP_GET, std::bind(&WebApp::_handleResource, this, std::placeholders::_1));
   }
 
   void bindRootPage(AsyncWebServer* webServer) {
@@ -158,7 +196,7 @@ class WebApp {
   WFormResponse handleHttpEventArgs(AsyncWebServerRequest* request, WList<WValue>* args) {
     WValue* formName = args->getById(WC_FORM);
     if (formName != nullptr) {
-      WebPageItem* pi = _webPages->getById(formName->asString());
+      WebPageItem* pi = _pageIndex->get(formName->asString());
       if (pi != nullptr) {
         WebPage* p = pi->initializer();
         return p->submitForm(args);
@@ -177,20 +215,60 @@ class WebApp {
   WStringStream* _stream = nullptr;
   unsigned long _lastPing = 0;
   WList<WebPageItem>* _webPages = new WList<WebPageItem>();
+  WIndex<WebPageItem>* _pageIndex = new WIndex<WebPageItem>();
 
   void _handleGet(AsyncWebServerRequest* request, WebPageItem* pi, String id) {
+    HEAP_TAG(HEAP_WEB);
     LOG->notice(F("Request with id '%s'"), id);
+    unsigned long start = micros();
+    uint32_t freeHeap = ESP.getFreeHeap();
+    if ((pi->cache != nullptr) && (pi->cache->send(request))) {
+      LOG->debug(F("Cached page sent in %lu us"), micros() - start);
+      return;
+    }
+    // pages link the bundle, so it must exist before the first page is rendered
+    _prepareResources();
     WebPage* page = pi->initializer();
-
-    AsyncResponseStream* stream = request->beginResponseStream(WC_TEXT_HTML, SIZE_RESPONSE_STREAM);
-    page->toString(stream);
+    if ((page->cacheable()) && (pi->cache == nullptr)) {
+      pi->cache = WebPageCache::create([page](Print* stream) { page->toString(stream); }, WC_TEXT_HTML, WC_NO_CACHE);
+      if ((pi->cache != nullptr) && (pi->cache->send(request))) {
+        delete page;
+        LOG->debug(F("Page rendered to cache in %lu us"), micros() - start);
+        return;
+      }
+    }
     if (!page->statefulWebPage()) {
-      delete page;
+      // rendered part by part while sending, the page lives until the request is done
+      WebChunkedResponse::send(request, WC_TEXT_HTML, [page](Print* stream, uint16_t step) { return page->printNext(stream); }, [page]() { delete page; });
     } else {
+      AsyncResponseStream* stream = request->beginResponseStream(WC_TEXT_HTML, SIZE_RESPONSE_STREAM);
+      page->toString(stream);
       pi->instance = page;
       pi->lastAlive = millis();
+      request->send(stream);
     }
-    request->send(stream);
+    LOG->debug(F("Page prepared in %lu us, heap used %d bytes"), micros() - start, (int)(freeHeap - ESP.getFreeHeap()));
+  }
+
+  void _handleResource(AsyncWebServerRequest* request) {
+    HEAP_TAG(HEAP_WEB);
+    _prepareResources();
+    // unknown hash, e.g. the bundle of a previous firmware
+    if (!WEB_RESOURCES->send(request)) request->send(404);
+  }
+
+  void _prepareResources() {
+    if (WEB_RESOURCES != nullptr) return;
+    unsigned long start = micros();
+    WEB_RESOURCES = new WebResourceBundle([this](WStringList* styles, WStringList* scripts) {
+      _webPages->forEach([styles, scripts](int index, WebPageItem* pi, const char* id) {
+        WebPage* page = pi->initializer();
+        page->createResources(styles, scripts);
+        delete page;
+      });
+    });
+    WEB_RESOURCES->build();
+    LOG->debug(F("Resource bundle built in %lu us"), micros() - start);
   }
 
   void _bind(AsyncWebServer* webServer, WebPageItem* pi, const char* id) {
@@ -4,12 +4,78 @@
 #include "WebSocketsServer.h"
 #include "WebResources.h"
 
+#ifndef WEBSOCKETS_SERVER_CLIENT_MAX
+#define WEBSOCKETS_SERVER_CLIENT_MAX 5
+#endif
+// A send taking longer had to wait for the tcp buffer of the client
+#define WS_SLOW_SEND_US 20000
+#define WS_MIN_BACKOFF 100
+#define WS_MAX_BACKOFF 5000
+// control messages kept per congested client
+#define WS_MAX_QUEUED 16
+
 WebSocketsServer* WEB_SOCKETS = nullptr;
 
+struct WWebSocketClient {
+  bool connected;
+  // while blocked, the client is skipped
+  unsigned long blockedSince;
+  uint16_t backoff;
+  uint32_t skipped;
+  // control messages not sent yet
+  WStringList* queued;
+};
+
+/*
+  Sends to web socket clients one by one. A client whose last send failed or
+  was slow is considered congested and skipped for a backoff time, which
+  doubles while it stays congested. So one slow browser doesn't stall the
+  others and the loop. JSON control messages for a congested client are
+  queued and sent by loop() once it recovers.
+*/
 class WebAppSockets {
  public:
-  static bool sendMessage(const char* event, const char* id, const char* data) {
-    if (WEB_SOCKETS != nullptr) { //} && (WEB_SOCKETS->availableForWriteAll())) {
+  static void connected(uint8_t num, bool connected) {
+    if (num >= WEBSOCKETS_SERVER_CLIENT_MAX) return;
+    _clients[num].connected = connected;
+    _clients[num].backoff = 0;
+    _clients[num].skipped = 0;
+    if (_clients[num].queued) _clients[num].queued->clear();
+  }
+
+  static bool isConnected(uint8_t num) { return ((num < WEBSOCKETS_SERVER_CLIENT_MAX) && (_clients[num].connected)); }
+
+  // false, if the client isn't connected or is congested
+  static bool writable(uint8_t num) {
+    if (!isConnected(num)) return false;
+    WWebSocketClient* client = &_clients[num];
+    if ((client->backoff > 0) && (millis() - client->blockedSince < client->backoff)) {
+      client->skipped++;
+      return false;
+    }
+    return true;
+  }
+
+  static uint32_t skipped(uint8_t num) { return (num < WEBSOCKETS_SERVER_CLIENT_MAX ? _clients[num].skipped : 0); }
+
+  static bool send(uint8_t num, const uint8_t* payload, size_t length, bool binary) {
+    if ((WEB_SOCKETS == nullptr) || (!writable(num))) return false;
+    unsigned long start = micros();
+    bool result = (binary ? WEB_SOCKETS->sendBIN(num, payload, length) : WEB_SOCKETS->sendTXT(num, (const char*)payload, length));
+    WWebSocketClient* client = &_clients[num];
+    if ((!result) || (micros() - start > WS_SLOW_SEND_US)) {
+      client->blockedSince = millis();
+      client->backoff = (client->backoff == 0 ? WS_MIN_BACKOFF : min(client->backoff * 2, WS_MAX_BACKOFF));
+      LOG->debug(F("WebSocket [%d] congested, backoff %d ms"), num, client->backoff);
+    } else {
+      client->backoff = 0;
+    }
+    return result;
+  }
+
+  // coalesce: the message carries a state, a queued one with the same event and id is replaced
+  static bool sendMessage(const char* event, const char* id, const char* data, bool coalesce = false) {
+    if (WEB_SOCKETS != nullptr) {
       WStringStream* response = createResponseStream();
       WJson* json = new WJson(response);
       json->beginObject();
@@ -21,12 +87,53 @@ class WebAppSockets {
       json->endObject();
       delete json;
       LOG->debug("Send> %s", response->c_str());
-      bool result = WEB_SOCKETS->broadcastTXT(response->c_str());
+      bool result = false;
+      for (uint8_t num = 0; num < WEBSOCKETS_SERVER_CLIENT_MAX; num++) {
+        if (!isConnected(num)) continue;
+        WWebSocketClient* client = &_clients[num];
+        // keeps the order, if older messages are still queued
+        bool sent = (((client->queued == nullptr) || (client->queued->empty())) && (send(num, (const uint8_t*)response->c_str(), response->length(), false)));
+        if (!sent) _queue(num, event, id, response->c_str(), coalesce);
+        result = true;
+      }
       delete response;
       return result;
     }
     return false;
   }
+
+  // Sends queued control messages of clients, that aren't congested anymore
+  static void loop() {
+    if (WEB_SOCKETS == nullptr) return;
+    for (uint8_t num = 0; num < WEBSOCKETS_SERVER_CLIENT_MAX; num++) {
+      WStringList* queued = _clients[num].queued;
+      while ((queued != nullptr) && (!queued->empty()) && (isConnected(num))) {
+        const char* message = queued->get(0);
+        if (!send(num, (const uint8_t*)message, strlen(message), false)) break;
+        queued->remove(0, true);
+      }
+    }
+  }
+
+ private:
+  static WWebSocketClient _clients[WEBSOCKETS_SERVER_CLIENT_MAX];
+
+  static void _queue(uint8_t num, const char* event, const char* id, const char* message, bool coalesce) {
+    WWebSocketClient* client = &_clients[num];
+    if (client->queued == nullptr) client->queued = new WStringList();
+    char key[48];
+    snprintf(key, sizeof(key), "%s/%s", event, (id != nullptr ? id : ""));
+    int index = (coalesce ? client->queued->indexOfId(key) : -1);
+    if (index > -1) {
+      client->queued->remove(index, true);
+    } else if (client->queued->size() >= WS_MAX_QUEUED) {
+      LOG->debug(F("WebSocket [%d] queue full, oldest message dropped"), num);
+      client->queued->remove(0, true);
+    }
+    client->queued->add(message, (coalesce ? key : nullptr));
+  }
 };
 
+WWebSocketClient WebAppSockets::_clients[WEBSOCKETS_SERVER_CLIENT_MAX] = {};
+
 #endif
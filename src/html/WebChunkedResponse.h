@@ -0,0 +1,109 @@
+#ifndef W_WEB_CHUNKED_RESPONSE_H
+#define W_WEB_CHUNKED_RESPONSE_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+/*
+  Fills the chunk buffer of a response. What doesn't fit is kept in a pending
+  buffer and goes first into the next chunk, so a piece of output is never
+  lost or printed twice.
+*/
+class WChunkPrint : public Print {
+ public:
+  virtual ~WChunkPrint() {
+    if (_pending) delete[] _pending;
+  }
+
+  // Starts the next chunk with the pending bytes of the previous one
+  void chunk(uint8_t* buffer, size_t size) {
+    _buffer = buffer;
+    _size = size;
+    _length = min(size, _pendingLength - _pendingStart);
+    memcpy(_buffer, _pending + _pendingStart, _length);
+    _pendingStart += _length;
+    if (_pendingStart == _pendingLength) _pendingStart = _pendingLength = 0;
+  }
+
+  virtual size_t write(uint8_t c) { return write(&c, 1); }
+
+  virtual size_t write(const uint8_t* buffer, size_t size) {
+    size_t n = (_pendingLength == 0 ? min(size, _size - _length) : 0);
+    memcpy(_buffer + _length, buffer, n);
+    _length += n;
+    if (n < size) _keep(buffer + n, size - n);
+    return size;
+  }
+
+  bool isFull() { return (_length == _size); }
+
+  // bytes in the current chunk
+  size_t length() { return _length; }
+
+ private:
+  uint8_t* _buffer = nullptr;
+  size_t _size = 0;
+  size_t _length = 0;
+  uint8_t* _pending = nullptr;
+  size_t _pendingCapacity = 0;
+  size_t _pendingStart = 0;
+  size_t _pendingLength = 0;
+
+  void _keep(const uint8_t* buffer, size_t size) {
+    if (_pendingLength + size > _pendingCapacity) {
+      _pendingCapacity = max(_pendingLength + size, 2 * _pendingCapacity);
+      uint8_t* pending = new uint8_t[_pendingCapacity];
+      if (_pending) {
+        memcpy(pending, _pending, _pendingLength);
+        delete[] _pending;
+      }
+      _pending = pending;
+    }
+    memcpy(_pending + _pendingLength, buffer, size);
+    _pendingLength += size;
+  }
+};
+
+/*
+  Sends a response with chunked transfer encoding. onStep prints the output
+  piece by piece (e.g. a control, a table row or a device) and returns false,
+  when nothing is left. Each piece is generated once; the response memory is
+  bounded by the chunk size plus the largest piece, not the response size.
+*/
+class WebChunkedResponse {
+ public:
+  typedef std::function<bool(Print* stream, uint16_t step)> TOnStep;
+  typedef std::function<void()> TOnDone;
+
+  // onDone is called, when the request is finished or the client disconnected
+  static void send(AsyncWebServerRequest* request, const char* contentType, TOnStep onStep, TOnDone onDone = nullptr) {
+    WebChunkedResponse* state = new WebChunkedResponse(onStep);
+    AsyncWebServerResponse* response = request->beginChunkedResponse(contentType, [state](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+      return state->_fill(buffer, maxLen);
+    });
+    request->onDisconnect([state, onDone]() {
+      delete state;
+      if (onDone) onDone();
+    });
+    request->send(response);
+  }
+
+ private:
+  TOnStep _onStep;
+  WChunkPrint _print;
+  uint16_t _step = 0;
+  bool _finished = false;
+
+  WebChunkedResponse(TOnStep onStep) { _onStep = onStep; }
+
+  // 0 ends the response
+  size_t _fill(uint8_t* buffer, size_t size) {
+    _print.chunk(buffer, size);
+    while ((!_finished) && (!_print.isFull())) {
+      _finished = !_onStep(&_print, _step++);
+    }
+    return _print.length();
+  }
+};
+
+#endif
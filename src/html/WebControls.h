@@ -8,49 +8,51 @@ class WebControl {
  public:
   typedef std::function<void(const char*)> WebControlHandler;
   WebControl(const char* tag, const char* params, ...) {
-    _tag = new char[strlen_P(tag) + 1];
-    strcpy_P(_tag, tag);
+    // created within the control tree of a page
+    _arena = WArena::current();
+    _tag = _copy(tag);
 
     va_list arg;
-    char* key = nullptr;
+    const char* key = nullptr;
     va_start(arg, params);
     while (params) {
       if (key == nullptr) {
-        key = new char[strlen_P(params) + 1];
-        strcpy_P(key, params);
+        // copied by the list, if needed
+        key = params;
       } else {
         // WKeyValue* kv = new WKeyValue(key, params);
         param(key, params);
-        delete key;
         key = nullptr;
       }
       params = va_arg(arg, const char*);
     }
     if (key != nullptr) {
       param(key, nullptr);
-      delete key;
       key = nullptr;
     }
     va_end(arg);
   }
 
+  // Controls in an arena must be released with WArena::destroy
   virtual ~WebControl() {
-    if (_tag) delete _tag;
-    if (_content) delete _content;
-    if (_params) delete _params;
-    if (_items) delete _items;
+    WArena::freeString(_arena, _tag);
+    WArena::freeString(_arena, _content);
+    WArena::destroy(_arena, _params);
+    WArena::destroy(_arena, _items);
   }
 
+  // Controls of a page are allocated from its arena and released with it
+  static void* operator new(size_t size) { return WArena::allocateCurrent(size); }
+
   typedef std::function<void(Print* stream)> WOnPrint;
   void contentFactory(WOnPrint contentFactory) {
     _contentFactory = contentFactory;
   }
 
   WebControl* content(const char* content) {
-    if (_content) delete _content;
-    _content = new char[strlen_P(content) + 1];
-    strcpy_P(_content, content);
-    WebAppSockets::sendMessage("textAreaUpdate", id(), _content);
+    WArena::freeString(_arena, _content);
+    _content = _copy(content);
+    WebAppSockets::sendMessage("textAreaUpdate", id(), _content, true);
     return this;
   }
 
@@ -65,7 +67,10 @@ class WebControl {
 
   void add(WebControl* kv) {
     if (kv != nullptr) {
-      if (_items == nullptr) _items = new WList<WebControl>();
+      if (_items == nullptr) {
+        WArena* arena = WArena::ifCurrent(_arena);
+        _items = (arena ? arena->create<WList<WebControl>>(false, arena) : new WList<WebControl>(false, _arena));
+      }
       _items->add(kv, kv->param(WC_ID));
     }
   }
@@ -75,7 +80,10 @@ class WebControl {
   }
 
   virtual WebControl* param(const char* key, const char* pattern, const char* params, ...) {
-    if (_params == nullptr) _params = new WStringList();
+    if (_params == nullptr) {
+      WArena* arena = WArena::ifCurrent(_arena);
+      _params = (arena ? arena->create<WStringList>(arena) : new WStringList(_arena));
+    }
     if ((pattern != nullptr) && (params != nullptr)) {
       va_list args2;
       va_start(args2, params);
@@ -123,17 +131,38 @@ class WebControl {
     if (_items) _items->forEach([this, scripts](int index, WebControl* wc, const char* id) { wc->createScripts(scripts); });
   }
 
-  virtual void toString(Print* stream) {
+  // A control is printed in parts, so a page can be sent piece by piece: printStart,
+  // printPart for index 0, 1, ... until it returns false, printEnd
+  virtual void printStart(Print* stream) {
     WHtml::command(stream, _tag, true, _params);
     if (_contentFactory) {
       _contentFactory(stream);
     } else if (_content) {
       stream->print(_content);
     }
-    if (_items) _items->forEach([this, stream](int index, WebControl* wc, const char* id) { wc->toString(stream); });
+  }
+
+  // Prints part index itself or hands out a child control for it; false, if there is no such part
+  virtual bool printPart(Print* stream, int index, WebControl*& child) {
+    if ((_items == nullptr) || (index >= _items->size())) return false;
+    child = _items->get(index);
+    return true;
+  }
+
+  virtual void printEnd(Print* stream) {
     if (_closing) WHtml::command(stream, _tag, false, nullptr);
   }
 
+  virtual void toString(Print* stream) {
+    printStart(stream);
+    WebControl* child = nullptr;
+    for (int i = 0; printPart(stream, i, child); i++) {
+      if (child) child->toString(stream);
+      child = nullptr;
+    }
+    printEnd(stream);
+  }
+
   WList<WebControl>* items() { return _items; }
 
   WebControl* getElementById(const char* id) {
@@ -148,12 +177,30 @@ class WebControl {
     }
   }
 
+  // Adds all descendants in the order getElementById finds them
+  void indexTo(WIndex<WebControl>* index) {
+    if (_items == nullptr) return;
+    _items->forEach([index](int i, WebControl* wc, const char* id) { index->put(id, wc); });
+    _items->forEach([index](int i, WebControl* wc, const char* id) { wc->indexTo(index); });
+  }
+
   virtual void handleEvent(WValue* event, WList<WValue>* data) {
   }
 
+ private:
+  const char* _copy(const char* text) {
+    if (text == nullptr) return nullptr;
+    WArena* arena = WArena::ifCurrent(_arena);
+    if (arena != nullptr) return arena->copy(text);
+    char* result = new char[strlen_P(text) + 1];
+    strcpy_P(result, text);
+    return result;
+  }
+
  protected:
-  char* _tag = nullptr;
-  char* _content = nullptr;
+  WArena* _arena;
+  const char* _tag = nullptr;
+  const char* _content = nullptr;
   WOnPrint _contentFactory = nullptr;
   bool _closing = true;
   WStringList* _params = nullptr;
@@ -237,10 +284,6 @@ class WebButton : public WebControl {
     return this;
   }
 
-  virtual void toString(Print* stream) {
-    WebControl::toString(stream);
-  }
-
   WebButton* onClick(WebControlHandler onClick) {
     param(WC_ON_CLICK, WC_SCRIPT_NAME_CONTROL_EVENT, WC_ON_CLICK, nullptr);
     _onClick = onClick;
@@ -442,7 +485,7 @@ class WebTable : public WebControl {
 
   static void dataCell(Print* stream, const char* data, bool editable = false) {
     WHtml::commandParamsAndNullptr(stream, WC_TABLE_DATA, true, (editable ? WC_CONTENT_EDITABLE : nullptr), (editable ? WC_TRUE : nullptr), nullptr);
-    if (data) stream->print(data);
+    if (data) WHtml::escape(stream, data);
     WHtml::command(stream, WC_TABLE_DATA, false, nullptr);
   }
 
@@ -493,19 +536,25 @@ class WebTable : public WebControl {
     return this;
   }
 
-  virtual void toString(Print* stream) {
+  virtual void printStart(Print* stream) {
     WHtml::command(stream, _tag, true, _params);
     if (_onPrintHeaderRow) {
       WHtml::command(stream, WC_TABLE_ROW, true, nullptr);
       _onPrintHeaderRow(stream, -1, nullptr, nullptr);
       WHtml::command(stream, WC_TABLE_ROW, false, nullptr);
     }
-    _datas->forEach([this, stream](int index, T* item, const char* id) {
+  }
+
+  // One row per part
+  virtual bool printPart(Print* stream, int index, WebControl*& child) {
+    if ((_datas == nullptr) || (index >= _datas->size())) return false;
+    T* item = _datas->get(index);
+    if (item != nullptr) {
       WHtml::command(stream, WC_TABLE_ROW, true, nullptr);
-      this->printRow(stream, index, item, id);
+      this->printRow(stream, index, item, _datas->getId(index));
       WHtml::command(stream, WC_TABLE_ROW, false, nullptr);
-    });
-    if (_closing) WHtml::command(stream, _tag, false, nullptr);
+    }
+    return true;
   }
 
  private:
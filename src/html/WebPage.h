@@ -2,6 +2,9 @@
 #define W_PAGE_H
 
 #include "WebControls.h"
+#include "WebResourceBundle.h"
+
+#define WEB_PAGE_MAX_DEPTH 16
 
 class WebPage;
 typedef std::function<WebPage*()> WebPageInitializer;
@@ -18,6 +21,22 @@ struct WFormResponse {
   WFormOperation operation;
 };
 
+// Position of a page, that is printed part by part
+struct WebPageWalk {
+  struct Frame {
+    WebControl* control;
+    int part;
+  };
+  WStringList* scripts = nullptr;
+  bool started = false;
+  byte depth = 0;
+  Frame frames[WEB_PAGE_MAX_DEPTH];
+
+  ~WebPageWalk() {
+    if (scripts) delete scripts;
+  }
+};
+
 class WebPage {
  public:
   WebPage(const char* title = nullptr, bool statefulWebPage = false)
@@ -34,7 +53,12 @@ class WebPage {
   }
 
   virtual ~WebPage() {
-    if (_parentNode) delete _parentNode;
+    // a response may end before the page is complete
+    if (_walk) delete _walk;
+    if (_index) delete _index;
+    WArena::destroy(_arena, _parentNode);
+    // after the controls, releases their memory at once
+    if (_arena) delete _arena;
     if (_title) delete[] _title;
   }
 
@@ -57,71 +81,58 @@ class WebPage {
     return WFormResponse();
   }
 
-  void toString(Print* stream) {
+  // Styles and scripts of this page, also collected for the resource bundle
+  void createResources(WStringList* styles, WStringList* scripts) {
     if (_parentNode == nullptr) {
-      _parentNode = new WebControl(WC_DIV, nullptr);
-      this->createControls(_parentNode);
+      _arena = new WArena();
+      {
+        WArenaScope scope(_arena);
+        _parentNode = new WebControl(WC_DIV, nullptr);
+        this->createControls(_parentNode);
+      }
+      // web socket events of stateful pages are dispatched by id
+      if (statefulWebPage()) {
+        _index = new WIndex<WebControl>();
+        _parentNode->indexTo(_index);
+      }
     }
-    WStringList* styles = new WStringList();
     styles->add(WC_STYLE_BODY, WC_BODY);
     styles->add(WC_STYLE_FORM_WHITE_BOX, WC_CSS_FORM_WHITE_BOX);
     _parentNode->createStyles(styles);
-    WStringList* scripts = new WStringList();
     _parentNode->createScripts(scripts);
-    // Print
-    WHtml::commandParamsAndNullptr(stream, WC_DOCTYPE_HTML, true, WC_HTML, nullptr);
-    WHtml::commandParamsAndNullptr(stream, WC_HTML, true, WC_LANG, F("en"), nullptr);
-    // Head
-    WHtml::command(stream, WC_HEAD, true);
-    WHtml::commandParamsAndNullptr(stream, WC_META, true, WC_NAME, F("viewport"), WC_CONTENT, F("width=device-width, initial-scale=1, user-scalable=no"), nullptr);
-    WHtml::command(stream, WC_TITLE, true);
-    if (_title) stream->print(_title);
-    WHtml::command(stream, WC_TITLE, false);  // Title end
-    WHtml::commandParamsAndNullptr(stream, WC_LINK, true, WC_REL, F("shortcut icon"), WC_TYPE, F("image/svg"), WC_HREF, WC_ICON_KAMSA, nullptr);
-    // Style
-    WHtml::command(stream, WC_STYLE, true);
-    styles->forEach([this, stream](int index, const char* style, const char* id) { WHtml::styleToString(stream, id, style); });
-    WHtml::command(stream, WC_STYLE, false);  // Style end
-    WHtml::command(stream, WC_HEAD, false);   // Head end
-    // Body
-    WHtml::command(stream, WC_BODY, true);
-    if (APPLICATION) {
-      WHtml::command(stream, WC_H1, true);
-      stream->print(APPLICATION);
-      WHtml::command(stream, WC_H1, false);
-    }
-    const char* id = SETTINGS->getString(WC_ID);
-    if (id != nullptr) {
-      WHtml::command(stream, WC_H2, true);
-      stream->print(F("Id: "));
-      stream->print(id);
-      WHtml::command(stream, WC_H2, false);
-    }
-    if (VERSION) {
-      WHtml::command(stream, WC_H2, true);
-      stream->print(F("Rev: "));
-      stream->print(VERSION);
-      if (DEBUG) stream->print(F(" (debug)"));
-      WHtml::command(stream, WC_H2, false);
+  }
+
+  // Prints the next part of the page; false, when the page is complete
+  bool printNext(Print* stream) {
+    if (_walk == nullptr) {
+      _walk = new WebPageWalk();
+      _printHead(stream);
+      return true;
     }
-    _parentNode->toString(stream);
-    // Scripts
-    if (!scripts->empty()) {
-      WHtml::command(stream, WC_SCRIPT, true);
-      if (statefulWebPage()) {
-        scripts->add(WC_SCRIPT_INITIALIZE_SOCKET);
+    if (_walk->depth == 0) {
+      if (_walk->started) {
+        _printTail(stream);
+        delete _walk;
+        _walk = nullptr;
+        return false;
       }
-      scripts->forEach([this, stream](int index, const char* script, const char* id) {
-        stream->print(script);
-        stream->print(WC_SEND);
-      });
-      WHtml::command(stream, WC_SCRIPT, false);
+      _walk->started = true;
+      _enter(stream, _parentNode);
+      return true;
     }
-    WHtml::command(stream, WC_BODY, false);  // Body end
-    WHtml::command(stream, WC_HTML, false);  // Page end
-    // Cleanup
-    delete styles;
-    delete scripts;
+    WebPageWalk::Frame* frame = &_walk->frames[_walk->depth - 1];
+    WebControl* child = nullptr;
+    if (frame->control->printPart(stream, frame->part++, child)) {
+      if (child != nullptr) _enter(stream, child);
+    } else {
+      frame->control->printEnd(stream);
+      _walk->depth--;
+    }
+    return true;
+  }
+
+  void toString(Print* stream) {
+    while (printNext(stream));
   }
 
   virtual void printPage() {
@@ -158,12 +169,33 @@ class WebPage {
     return this;
   }
 
+  // Stateful pages that show property values live: the browser subscribes to the binary state push (see WebStatePush)
+  bool statePush() { return _statePush; }
+
+  WebPage* statePush(bool statePush) {
+    _statePush = statePush;
+    return this;
+  }
+
+  // Cacheable pages render the same html on every request, they are rendered once and kept gzip compressed
+  bool cacheable() { return _cacheable; }
+
+  WebPage* cacheable(bool cacheable) {
+    _cacheable = cacheable;
+    return this;
+  }
+
   WebControl* getElementById(const char* id) {
-    return (_parentNode != nullptr ? _parentNode->getElementById(id) : nullptr);
+    if (_parentNode == nullptr) return nullptr;
+    WebControl* result = (_index != nullptr ? _index->get(id) : nullptr);
+    // controls added after the page was created aren't indexed
+    return (result != nullptr ? result : _parentNode->getElementById(id));
   }
 
  protected:
   bool _statefulWebPage;
+  bool _cacheable = false;
+  bool _statePush = false;
 
  private:
   char* _title;
@@ -172,6 +204,83 @@ class WebPage {
   TPrintPage _onPrintPage;
   TSubmitPage _onSubmitPage;
   WebControl* _parentNode = nullptr;
+  WIndex<WebControl>* _index = nullptr;
+  WArena* _arena = nullptr;
+  WebPageWalk* _walk = nullptr;
+
+  void _printHead(Print* stream) {
+    WStringList* styles = new WStringList();
+    _walk->scripts = new WStringList();
+    this->createResources(styles, _walk->scripts);
+    // Print
+    WHtml::commandParamsAndNullptr(stream, WC_DOCTYPE_HTML, true, WC_HTML, nullptr);
+    WHtml::commandParamsAndNullptr(stream, WC_HTML, true, WC_LANG, F("en"), nullptr);
+    // Head
+    WHtml::command(stream, WC_HEAD, true);
+    WHtml::commandParamsAndNullptr(stream, WC_META, true, WC_NAME, F("viewport"), WC_CONTENT, F("width=device-width, initial-scale=1, user-scalable=no"), nullptr);
+    WHtml::command(stream, WC_TITLE, true);
+    if (_title) stream->print(_title);
+    WHtml::command(stream, WC_TITLE, false);  // Title end
+    WHtml::commandParamsAndNullptr(stream, WC_LINK, true, WC_REL, F("shortcut icon"), WC_TYPE, F("image/svg"), WC_HREF, WC_ICON_KAMSA, nullptr);
+    // Style, only what isn't part of the bundle is inlined
+    if (WEB_RESOURCES) WEB_RESOURCES->printStyleLink(stream);
+    WHtml::command(stream, WC_STYLE, true);
+    WebResourceBundle::printStyles(stream, styles, true);
+    WHtml::command(stream, WC_STYLE, false);  // Style end
+    WHtml::command(stream, WC_HEAD, false);   // Head end
+    delete styles;
+    // Body
+    WHtml::command(stream, WC_BODY, true);
+    if (APPLICATION) {
+      WHtml::command(stream, WC_H1, true);
+      stream->print(APPLICATION);
+      WHtml::command(stream, WC_H1, false);
+    }
+    const char* id = SETTINGS->getString(WC_ID);
+    if (id != nullptr) {
+      WHtml::command(stream, WC_H2, true);
+      stream->print(F("Id: "));
+      stream->print(id);
+      WHtml::command(stream, WC_H2, false);
+    }
+    if (VERSION) {
+      WHtml::command(stream, WC_H2, true);
+      stream->print(F("Rev: "));
+      stream->print(VERSION);
+      if (DEBUG) stream->print(F(" (debug)"));
+      WHtml::command(stream, WC_H2, false);
+    }
+  }
+
+  // Prints the start of a control and continues with its parts, deeper trees are printed at once
+  void _enter(Print* stream, WebControl* control) {
+    if (_walk->depth < WEB_PAGE_MAX_DEPTH) {
+      control->printStart(stream);
+      _walk->frames[_walk->depth].control = control;
+      _walk->frames[_walk->depth].part = 0;
+      _walk->depth++;
+    } else {
+      control->toString(stream);
+    }
+  }
+
+  void _printTail(Print* stream) {
+    // Scripts
+    if (!_walk->scripts->empty()) {
+      if (WEB_RESOURCES) WEB_RESOURCES->printScriptLink(stream);
+      if (statefulWebPage()) {
+        _walk->scripts->add(WC_SCRIPT_INITIALIZE_SOCKET);
+        if (statePush()) _walk->scripts->add(WC_SCRIPT_STATE_PUSH);
+      }
+      if (WebResourceBundle::hasUnbundledScripts(_walk->scripts)) {
+        WHtml::command(stream, WC_SCRIPT, true);
+        WebResourceBundle::printScripts(stream, _walk->scripts, true);
+        WHtml::command(stream, WC_SCRIPT, false);
+      }
+    }
+    WHtml::command(stream, WC_BODY, false);  // Body end
+    WHtml::command(stream, WC_HTML, false);  // Page end
+  }
 };
 
 #endif
@@ -0,0 +1,102 @@
+#ifndef W_WEB_PAGE_CACHE_H
+#define W_WEB_PAGE_CACHE_H
+
+#include "../WGzip.h"
+#include "WebControls.h"
+
+// Counts the bytes of a page without keeping them
+class WCountingPrint : public Print {
+ public:
+  virtual size_t write(uint8_t c) {
+    _count++;
+    return 1;
+  }
+
+  virtual size_t write(const uint8_t* buffer, size_t size) {
+    _count += size;
+    return size;
+  }
+
+  size_t count() { return _count; }
+
+ private:
+  size_t _count = 0;
+};
+
+/*
+  Rendered and gzip compressed content, e.g. the html of a cacheable page. It's
+  built once and then sent as is, with an ETag, so browsers revalidate with
+  If-None-Match and get a 304 without any body.
+*/
+class WebPageCache {
+ public:
+  typedef std::function<void(Print*)> TOnPrint;
+
+  ~WebPageCache() {
+    if (_data) delete[] _data;
+  }
+
+  // onPrint must print the same content on every call. Returns nullptr, if the content is too large or memory is short
+  static WebPageCache* create(TOnPrint onPrint, const char* contentType, const char* cacheControl) {
+    WCountingPrint counter;
+    onPrint(&counter);
+    WStringStream* content = new (std::nothrow) WStringStream(counter.count());
+    if (content == nullptr) return nullptr;
+    onPrint(content);
+    size_t length;
+    uint32_t crc;
+    uint8_t* data = WGzip::compress((const uint8_t*)content->c_str(), content->length(), &length, &crc);
+    LOG->debug(F("Cached %s: %d bytes, gzip %d bytes"), contentType, content->length(), length);
+    delete content;
+    if (data == nullptr) return nullptr;
+    WebPageCache* cache = new WebPageCache();
+    // WGzip allocates for the worst case, keep only what's needed
+    cache->_data = new (std::nothrow) uint8_t[length];
+    if (cache->_data != nullptr) {
+      memcpy(cache->_data, data, length);
+      delete[] data;
+    } else {
+      cache->_data = data;
+    }
+    cache->_length = length;
+    cache->_crc = crc;
+    cache->_contentType = contentType;
+    cache->_cacheControl = cacheControl;
+    snprintf(cache->_etag, sizeof(cache->_etag), "\"%08lx\"", (unsigned long)crc);
+    return cache;
+  }
+
+  // false, if the client doesn't accept gzip and the page must be rendered
+  bool send(AsyncWebServerRequest* request) {
+    if ((request->hasHeader(WC_IF_NONE_MATCH)) && (request->header(WC_IF_NONE_MATCH) == _etag)) {
+      AsyncWebServerResponse* response = request->beginResponse(304);
+      response->addHeader(WC_ETAG, _etag);
+      request->send(response);
+      return true;
+    }
+    if ((!request->hasHeader(WC_ACCEPT_ENCODING)) || (request->header(WC_ACCEPT_ENCODING).indexOf(WC_GZIP) < 0)) {
+      return false;
+    }
+    AsyncWebServerResponse* response = request->beginResponse_P(200, _contentType, _data, _length);
+    response->addHeader(WC_CONTENT_ENCODING, WC_GZIP);
+    response->addHeader(WC_CACHE_CONTROL, _cacheControl);
+    response->addHeader(WC_ETAG, _etag);
+    request->send(response);
+    return true;
+  }
+
+  size_t length() { return _length; }
+
+  // crc32 of the uncompressed content
+  uint32_t crc() { return _crc; }
+
+ private:
+  uint8_t* _data = nullptr;
+  size_t _length = 0;
+  uint32_t _crc = 0;
+  const char* _contentType;
+  const char* _cacheControl;
+  char _etag[11];
+};
+
+#endif
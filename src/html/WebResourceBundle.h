@@ -0,0 +1,152 @@
+#ifndef W_WEB_RESOURCE_BUNDLE_H
+#define W_WEB_RESOURCE_BUNDLE_H
+
+#include "WebPageCache.h"
+
+#define WEB_RESOURCE_PATH "/r"
+// "/r/" + 8 hex digits + ".css"
+#define WEB_RESOURCE_URL_LENGTH 20
+
+class WebResourceBundle;
+WebResourceBundle* WEB_RESOURCES = nullptr;
+
+/*
+  Union of the styles and scripts of all web pages, served gzip compressed at
+  content-hashed urls with a long-lived cache header. Pages only reference it
+  and inline what isn't part of the bundle, so browsers load the css/js once.
+*/
+class WebResourceBundle {
+ public:
+  typedef std::function<void(WStringList* styles, WStringList* scripts)> TOnCollect;
+
+  // onCollect is called at build and if a client doesn't accept gzip
+  WebResourceBundle(TOnCollect onCollect) {
+    _onCollect = onCollect;
+  }
+
+  ~WebResourceBundle() {
+    if (_css) delete _css;
+    if (_js) delete _js;
+    if (_styleIds) delete[] _styleIds;
+    if (_scriptIds) delete[] _scriptIds;
+  }
+
+  void build() {
+    WStringList* styles = new WStringList();
+    WStringList* scripts = new WStringList();
+    _onCollect(styles, scripts);
+    _css = WebPageCache::create([styles](Print* stream) { _printStyles(stream, styles); }, WC_TEXT_CSS, WC_CACHE_IMMUTABLE);
+    _js = WebPageCache::create([scripts](Print* stream) { _printScripts(stream, scripts); }, WC_TEXT_JAVASCRIPT, WC_CACHE_IMMUTABLE);
+    if (_css) _styleIds = _hashIds(styles, &_styleCount);
+    if (_js) _scriptIds = _hashIds(scripts, &_scriptCount);
+    if (_css) snprintf(_cssUrl, WEB_RESOURCE_URL_LENGTH, "%s/%08lx.css", WEB_RESOURCE_PATH, (unsigned long)_css->crc());
+    if (_js) snprintf(_jsUrl, WEB_RESOURCE_URL_LENGTH, "%s/%08lx.js", WEB_RESOURCE_PATH, (unsigned long)_js->crc());
+    delete styles;
+    delete scripts;
+  }
+
+  // Scripts without id are matched by their text
+  bool containsStyle(const char* style, const char* id) { return _contains(_styleIds, _styleCount, style, id); }
+
+  bool containsScript(const char* script, const char* id) { return _contains(_scriptIds, _scriptCount, script, id); }
+
+  void printStyleLink(Print* stream) {
+    if (_css) WHtml::commandParamsAndNullptr(stream, WC_LINK, true, WC_REL, WC_STYLESHEET, WC_HREF, _cssUrl, nullptr);
+  }
+
+  void printScriptLink(Print* stream) {
+    if (_js) {
+      WHtml::commandParamsAndNullptr(stream, WC_SCRIPT, true, WC_SRC, _jsUrl, nullptr);
+      WHtml::command(stream, WC_SCRIPT, false);
+    }
+  }
+
+  // false, if the url is not part of this bundle, e.g. from an older firmware
+  bool send(AsyncWebServerRequest* request) {
+    String url = request->url();
+    bool css = ((_css) && (url == _cssUrl));
+    if ((!css) && ((!_js) || (url != _jsUrl))) return false;
+    if (!(css ? _css : _js)->send(request)) {
+      // without gzip, collected again for this request only
+      AsyncResponseStream* stream = request->beginResponseStream(css ? WC_TEXT_CSS : WC_TEXT_JAVASCRIPT);
+      WStringList* styles = new WStringList();
+      WStringList* scripts = new WStringList();
+      _onCollect(styles, scripts);
+      if (css) {
+        _printStyles(stream, styles);
+      } else {
+        _printScripts(stream, scripts);
+      }
+      delete styles;
+      delete scripts;
+      request->send(stream);
+    }
+    return true;
+  }
+
+  static void printStyles(Print* stream, WStringList* styles, bool unbundledOnly) {
+    styles->forEach([stream, unbundledOnly](int index, const char* style, const char* id) {
+      if ((!unbundledOnly) || (WEB_RESOURCES == nullptr) || (!WEB_RESOURCES->containsStyle(style, id))) WHtml::styleToString(stream, id, style);
+    });
+  }
+
+  static void printScripts(Print* stream, WStringList* scripts, bool unbundledOnly) {
+    scripts->forEach([stream, unbundledOnly](int index, const char* script, const char* id) {
+      if ((!unbundledOnly) || (WEB_RESOURCES == nullptr) || (!WEB_RESOURCES->containsScript(script, id))) {
+        stream->print(script);
+        stream->print(WC_SEND);
+      }
+    });
+  }
+
+  // true, if at least one of the scripts isn't part of the bundle
+  static bool hasUnbundledScripts(WStringList* scripts) {
+    if (WEB_RESOURCES == nullptr) return !scripts->empty();
+    bool result = false;
+    scripts->forEach([&result](int index, const char* script, const char* id) {
+      if (!WEB_RESOURCES->containsScript(script, id)) result = true;
+    });
+    return result;
+  }
+
+ private:
+  TOnCollect _onCollect;
+  WebPageCache* _css = nullptr;
+  WebPageCache* _js = nullptr;
+  uint32_t* _styleIds = nullptr;
+  uint32_t* _scriptIds = nullptr;
+  uint16_t _styleCount = 0;
+  uint16_t _scriptCount = 0;
+  char _cssUrl[WEB_RESOURCE_URL_LENGTH];
+  char _jsUrl[WEB_RESOURCE_URL_LENGTH];
+
+  static void _printStyles(Print* stream, WStringList* styles) { printStyles(stream, styles, false); }
+
+  static void _printScripts(Print* stream, WStringList* scripts) { printScripts(stream, scripts, false); }
+
+  // FNV-1a of the id, or of the value if there is no id
+  static uint32_t _hash(const char* value, const char* id) {
+    const char* key = (id != nullptr ? id : value);
+    uint32_t result = 2166136261UL;
+    for (; (key != nullptr) && (*key != '\0'); key++) result = (result ^ (uint8_t)*key) * 16777619UL;
+    return result;
+  }
+
+  static uint32_t* _hashIds(WStringList* list, uint16_t* count) {
+    *count = list->size();
+    uint32_t* result = new uint32_t[*count];
+    list->forEach([result](int index, const char* value, const char* id) { result[index] = _hash(value, id); });
+    return result;
+  }
+
+  static bool _contains(uint32_t* ids, uint16_t count, const char* value, const char* id) {
+    if (ids == nullptr) return false;
+    uint32_t h = _hash(value, id);
+    for (uint16_t i = 0; i < count; i++) {
+      if (ids[i] == h) return true;
+    }
+    return false;
+  }
+};
+
+#endif
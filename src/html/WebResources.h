@@ -5,14 +5,19 @@
 #include "Arduino.h"
 
 const static char WC_ACCEPT[] PROGMEM = "accept";
+const static char WC_ACCEPT_ENCODING[] PROGMEM = "Accept-Encoding";
 const static char WC_ACTION[] PROGMEM = "action";
 const static char WC_BACK_TO_MAINMENU[] PROGMEM = "Back to configuration";
 const static char WC_BODY[] PROGMEM = R"=====(body)=====";
 const static char WC_BUTTON[] PROGMEM = R"=====(button)=====";
+const static char WC_CACHE_CONTROL[] PROGMEM = "Cache-Control";
+const static char WC_CACHE_IMMUTABLE[] PROGMEM = "public, max-age=31536000, immutable";
 const static char WC_CLASS[] PROGMEM = R"=====(class)=====";
 const static char WC_CONTENT[] PROGMEM = R"=====(content)=====";
 const static char WC_CONTENT_EDITABLE[] PROGMEM = "contenteditable"; 
 const static char WC_CONFIG[] PROGMEM = "config";
+const static char WC_CONTENT_ENCODING[] PROGMEM = "Content-Encoding";
+const static char WC_CONTENT_RANGE[] PROGMEM = "Content-Range";
 const static char WC_CSS_BUTTON_HOVER[] PROGMEM = "button:hover";
 const static char WC_CSS_FORM_WHITE_BOX[] PROGMEM = "form, .wb";
 const static char WC_CSS_CHECK_BOX[] PROGMEM = ".cb input[type='checkbox']";
@@ -22,6 +27,8 @@ const static char WC_CSS_CHECK_BOX_CHECKED_LABEL_BEFORE[] PROGMEM = ".cb input[t
 const static char WC_COLS[] PROGMEM = "cols";
 const static char WC_DIV[] PROGMEM = "div";
 const static char WC_ENCTYPE[] PROGMEM = "enctype";
+const static char WC_ERROR[] PROGMEM = "error";
+const static char WC_ETAG[] PROGMEM = "ETag";
 const static char WC_EVENT[] PROGMEM = "event";
 const static char WC_DATA[] PROGMEM = "data";
 const static char WC_DOCTYPE_HTML[] PROGMEM = "!DOCTYPE";
@@ -32,6 +39,7 @@ const static char WC_FOR[] PROGMEM = "for";
 const static char WC_FORM[] PROGMEM = "form";
 const static char WC_FUNCTION[] PROGMEM = "function";
 const static char WC_GET[] PROGMEM = "get";
+const static char WC_GZIP[] PROGMEM = "gzip";
 const static char WC_H1[] PROGMEM = "h1";
 const static char WC_H2[] PROGMEM = "h2";
 const static char WC_HEAD[] PROGMEM = "head";
@@ -40,6 +48,7 @@ const static char WC_HISTORY_BACK[] PROGMEM = "history.back()";
 const static char WC_HTML[] PROGMEM = "html";
 const static char WC_HTTP[] PROGMEM = "http";
 const static char WC_HREF[] PROGMEM = "href";
+const static char WC_IF_NONE_MATCH[] PROGMEM = "If-None-Match";
 const static char WC_INFO[] PROGMEM = "info";
 const static char WC_INPUT[] PROGMEM = "input";
 const static char WC_LABEL[] PROGMEM = "label";
@@ -56,12 +65,15 @@ const static char WC_MQTT_SERVER[] PROGMEM = "mqttserver";
 const static char WC_MQTT_USER[] PROGMEM = "mqttuser";
 const static char WC_MULTIPART_FORM_DATA[] PROGMEM = "multipart/form-data";
 const static char WC_NAME[] PROGMEM = "name";
+const static char WC_NO_CACHE[] PROGMEM = "no-cache";
+const static char WC_OFFSET[] PROGMEM = "offset";
 const static char WC_ON_CHANGE[] PROGMEM = "onchange";
 const static char WC_ON_CLICK[] PROGMEM = "onclick";
 const static char WC_OPTION[] PROGMEM = "option";
 const static char WC_PASSWORD[] PROGMEM = "password";
 const static char WC_PING[] PROGMEM = "PING";
 const static char WC_POST[] PROGMEM = "post";
+const static char WC_PROFILER[] PROGMEM = "profiler";
 const static char WC_REL[] PROGMEM = "rel";
 const static char WC_RESET[] PROGMEM = "reset";
 const static char WC_ROWS[] PROGMEM = "rows";
@@ -69,10 +81,13 @@ const static char WC_SAVE_CONFIGURATION[] PROGMEM = "Save configuration";
 const static char WC_SCRIPT[] PROGMEM = "script";
 const static char WC_SELECT[] PROGMEM = "select";
 const static char WC_SELECTED[] PROGMEM = "selected";
+const static char WC_SIZE[] PROGMEM = "size";
 const static char WC_SPAN[] PROGMEM = "span";
+const static char WC_SRC[] PROGMEM = "src";
 const static char WC_SSID[] PROGMEM = "ssid";
 const static char WC_STATE[] PROGMEM = "state";
 const static char WC_STYLE[] PROGMEM = "style";
+const static char WC_STYLESHEET[] PROGMEM = "stylesheet";
 const static char WC_SUBMIT[] PROGMEM = "submit";
 const static char WC_TABLE[] PROGMEM = "table";
 const static char WC_TABLE_DATA[] PROGMEM = "td";
@@ -81,12 +96,15 @@ const static char WC_TABLE_ROW[] PROGMEM = "tr";
 const static char WC_TCP[] PROGMEM = "tcp";
 const static char WC_TEXT[] PROGMEM = "text";
 const static char WC_TEXTAREA[] PROGMEM = "textarea";
+const static char WC_TEXT_CSS[] PROGMEM = "text/css";
 const static char WC_TEXT_HTML[] PROGMEM = "text/html";
+const static char WC_TEXT_JAVASCRIPT[] PROGMEM = "application/javascript";
 const static char WC_URL[] PROGMEM = "url";
 const static char WC_VALUE[] PROGMEM = "value";
 const static char WC_WHITE_BOX[] PROGMEM = "wb";
 const static char WC_WIDTH_100PERCENT[] PROGMEM = "width:100%";
 const static char WC_WIFI[] PROGMEM = "wifi";
+const static char WC_X_SHA256[] PROGMEM = "X-Sha256";
 const static char WC_ICON_KAMSA[] PROGMEM = "data:image/svg+xml;base64,PHN2ZyB4bWxucz0naHR0cDovL3d3dy53My5vcmcvMjAwMC9zdmcnIHZpZXdCb3g9JzAgMCAxMDAgMTAwJz48cGF0aCBkPSdNIDUwIDAgQSA1MCA1MCAwIDAgMCAwIDUwIEEgNTAgNTAgMCAwIDAgNTAgMTAwIEEgNTAgNTAgMCAwIDAgMTAwIDUwIEEgNTAgNTAgMCAwIDAgNTAgMCBBIDUwIDUwIDAgMCAwIDUwIDAgeiBNIDUwIDUgQSA0NSA0NSAwIDAgMSA1MCA1IEEgNDUgNDUgMCAwIDEgOTUgNTAgQSA0NSA0NSAwIDAgMSA1MCA5NSBBIDQ1IDQ1IDAgMCAxIDUgNTAgQSA0NSA0NSAwIDAgMSA1MCA1IHogTSA0NSw2IDQzLDM3IDY0LDU4IDQxLjUsNzAuNSB2IDAgbCA0Miw4IC0xOSwtMjAgMCwwIHogTSA0MywzNyAyMCw4MiA0MS4zLDcwLjcgNDMsMzcgWicgZmlsbD0nIzI0QjNBOCcgLz48L3N2Zz4=";
 const static char WC_STYLE_BODY[] PROGMEM = "text-align:center; font-family:sans-serif; font-size:1.2rem; background-color: #474e5d; color: white;";    
 const static char WC_STYLE_FORM_WHITE_BOX[] PROGMEM = "text-align:left; display: inline-block;	border-radius: 0.3rem; padding: 1rem; background-color: white; color: #404040;";      
@@ -187,6 +205,8 @@ webSocket.onopen = function() {
 };
 
 webSocket.onmessage = function(event) {
+  // binary frames are state pushes, see WC_SCRIPT_STATE_PUSH
+  if (typeof event.data !== "string") return;
   var payload = event.data;
   console.log(payload);
   var json = JSON.parse(event.data);
@@ -225,6 +245,77 @@ function executeFunctionByName(functionName, context /*, args */) {
 
 )=====";
 
+const static char WC_SCRIPT_STATE_PUSH[] PROGMEM = R"=====(
+webSocket.binaryType = "arraybuffer";
+var stateNames = [];
+
+webSocket.addEventListener("open", function() {
+  webSocket.send(new Uint8Array([4]));
+});
+
+webSocket.addEventListener("message", function(event) {
+  if (event.data instanceof ArrayBuffer) stateFrame(new DataView(event.data));
+});
+
+function stateFrame(view) {
+  var p = 1;
+  var i;
+  if (view.getUint8(0) == 1) {
+    i = view.getUint16(p, true);
+    p += 2;
+    while (p < view.byteLength) {
+      var l = view.getUint8(p + 1);
+      stateNames[i++] = new TextDecoder().decode(new Uint8Array(view.buffer, p + 2, l));
+      p += 2 + l;
+    }
+  } else if (view.getUint8(0) == 2) {
+    while (p < view.byteLength) {
+      i = view.getUint16(p, true);
+      var type = view.getUint8(p + 2);
+      var value = null;
+      var l = 0;
+      p += 3;
+      switch (type) {
+        case 0: value = (view.getUint8(p) != 0); l = 1; break;
+        case 1: value = view.getFloat32(p, true); l = 4; break;
+        case 2: value = view.getInt16(p, true); l = 2; break;
+        case 3: value = view.getUint16(p, true); l = 2; break;
+        case 4: value = view.getInt32(p, true); l = 4; break;
+        case 5: value = view.getUint32(p, true); l = 4; break;
+        case 6: value = view.getUint8(p); l = 1; break;
+        case 7: l = 1 + view.getUint8(p); value = new TextDecoder().decode(new Uint8Array(view.buffer, p + 1, l - 1)); break;
+        case 8: l = 1 + view.getUint8(p); value = Array.from(new Uint8Array(view.buffer, p + 1, l - 1)); break;
+      }
+      p += l;
+      stateUpdate(stateNames[i], value);
+    }
+  }
+}
+
+function stateUpdate(name, value) {
+  var elem = document.getElementById(name);
+  if (elem === null) return;
+  if (elem.type === "checkbox") {
+    elem.checked = value;
+  } else if ("value" in elem) {
+    elem.value = value;
+  } else {
+    elem.textContent = value;
+  }
+}
+
+function setState(name, value) {
+  var i = stateNames.indexOf(name);
+  if ((i < 0) || (webSocket.readyState !== 1)) return;
+  var text = new TextEncoder().encode(String(value));
+  var frame = new Uint8Array(3 + text.length);
+  frame[0] = 3;
+  frame[1] = i & 0xFF;
+  frame[2] = i >> 8;
+  frame.set(text, 3);
+  webSocket.send(frame);
+)=====";
+
 const static char WC_SCRIPT_NAME_CONTROL_EVENT[] PROGMEM = "controlEvent(this, '%s')";
 
 const static char WC_SCRIPT_CONTROL_EVENT[] PROGMEM = R"=====(
@@ -344,6 +435,38 @@ class WHtml {
     stream->print(WC_GREATER);
   }
 
+  // Text as content or attribute value: &, <, >, " and ' as entities
+  static void escape(Print* stream, const char* text) {
+    const char* run = text;
+    const char* p = text;
+    for (char c = *p; c != '\0'; c = *(++p)) {
+      const char* entity;
+      switch (c) {
+        case '&':
+          entity = "&amp;";
+          break;
+        case '<':
+          entity = "&lt;";
+          break;
+        case '>':
+          entity = "&gt;";
+          break;
+        case '"':
+          entity = "&quot;";
+          break;
+        case '\'':
+          entity = "&#39;";
+          break;
+        default:
+          continue;
+      }
+      if (p > run) stream->write((const uint8_t*)run, p - run);
+      stream->print(entity);
+      run = p + 1;
+    }
+    if (p > run) stream->write((const uint8_t*)run, p - run);
+  }
+
   static void breakLine(Print* stream) {
     command(stream, PSTR("br"), true);
   }
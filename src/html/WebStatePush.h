@@ -0,0 +1,306 @@
+#ifndef W_WEB_STATE_PUSH_H
+#define W_WEB_STATE_PUSH_H
+
+#include "../WDevice.h"
+#include "WebAppSockets.h"
+
+#define WS_STATE_INTERVAL 250
+#define WS_STATE_FRAME_SIZE 512
+// bounds the time spent in one loop, what's left is sent in the next interval
+#define WS_STATE_FRAMES_PER_LOOP 4
+#define WS_STATE_VALUE_LENGTH 128
+// first byte of every binary frame
+#define WS_STATE_INDEX 1
+#define WS_STATE_VALUES 2
+#define WS_STATE_SET 3
+#define WS_STATE_SUBSCRIBE 4
+// set in the type byte of a property without value
+#define WS_STATE_NULL 0x80
+
+class WebStatePush;
+WebStatePush* WEB_STATE = nullptr;
+
+struct WStateEntry {
+  WDevice* device;
+  const char* id;
+  WProperty* property;
+};
+
+/*
+  Pushes property changes to the web socket clients as compact binary deltas.
+  Only clients of pages with statePush() subscribe; others get nothing and
+  cost no memory here. Changes are only flagged per client and sent coalesced
+  once per interval, so a fast changing sensor costs one value per frame,
+  whatever its update rate. A subscribed client gets the index and a snapshot
+  of all values first. Congested clients are skipped (see WebAppSockets),
+  their changes stay flagged.
+
+  Frames, little endian:
+    index:  1, first index:u16, per property type:u8, name length:u8, "device.property"
+    values: 2, per property index:u16, type:u8, value
+            (bool/byte 1, short 2, int/unsigned long 4, double as float 4,
+             string/byte array length:u8 + bytes; type | 0x80 without value)
+    set:    3, index:u16, value as text (from the browser)
+    subscribe: 4 (from the browser)
+*/
+class WebStatePush {
+ public:
+  WebStatePush() {
+    for (byte i = 0; i < WEBSOCKETS_SERVER_CLIENT_MAX; i++) {
+      _pending[i] = nullptr;
+      _indexPending[i] = false;
+    }
+  }
+
+  ~WebStatePush() {
+    if (_entries) delete[] _entries;
+    if (_frame) delete[] _frame;
+    for (byte i = 0; i < WEBSOCKETS_SERVER_CLIENT_MAX; i++) {
+      if (_pending[i]) delete[] _pending[i];
+    }
+  }
+
+  uint16_t interval() { return _interval; }
+
+  void interval(uint16_t interval) { _interval = interval; }
+
+  uint16_t size() { return _count; }
+
+  // Adds the properties registered since the last call. Indexes of known properties don't change
+  void build(WList<WDevice>* devices) {
+    uint16_t capacity = 0;
+    devices->forEach([&capacity](int index, WDevice* device, const char* id) { capacity += device->properties()->size(); });
+    WStateEntry* entries = new WStateEntry[capacity];
+    if (_count > 0) memcpy(entries, _entries, sizeof(WStateEntry) * _count);
+    uint16_t count = _count;
+    devices->forEach([this, entries, &count](int index, WDevice* device, const char* deviceId) {
+      device->properties()->forEach([this, entries, &count, device](int index, WProperty* property, const char* id) {
+        if ((!property->isVisible(WEBTHING)) || (property->type() == WDataType::LIST)) return;
+        for (uint16_t i = 0; i < count; i++) {
+          if (entries[i].property == property) return;
+        }
+        entries[count] = {device, id, property};
+        uint16_t i = count;
+        property->addListener([i, property]() {
+          if (WEB_STATE) WEB_STATE->changed(i, property);
+        });
+        count++;
+      });
+    });
+    if (_entries) delete[] _entries;
+    _entries = entries;
+    if (count == _count) return;
+    _count = count;
+    _words = (_count + 31) / 32;
+    // subscribed clients get the new index and a new snapshot
+    for (byte num = 0; num < WEBSOCKETS_SERVER_CLIENT_MAX; num++) {
+      if (_pending[num]) subscribe(num, true);
+    }
+  }
+
+  // A subscribed client gets the index and a snapshot with the next push, then the changes
+  void subscribe(uint8_t num, bool subscribe) {
+    if (num >= WEBSOCKETS_SERVER_CLIENT_MAX) return;
+    if (_pending[num]) delete[] _pending[num];
+    _pending[num] = nullptr;
+    if (subscribe) {
+      if (_frame == nullptr) _frame = new uint8_t[WS_STATE_FRAME_SIZE];
+      _pending[num] = new uint32_t[_words];
+    }
+    _flagAll(num, subscribe);
+  }
+
+  void changed(uint16_t index, WProperty* property) {
+    if ((index >= _count) || (_entries[index].property != property)) return;
+    for (byte num = 0; num < WEBSOCKETS_SERVER_CLIENT_MAX; num++) {
+      if (_pending[num]) _pending[num][index / 32] |= (1UL << (index % 32));
+    }
+  }
+
+  // Subscribe or set frame from the browser. Returns false, if it isn't one
+  bool handleFrame(uint8_t num, const uint8_t* payload, size_t length) {
+    if ((length == 1) && (payload[0] == WS_STATE_SUBSCRIBE)) {
+      subscribe(num, true);
+      return true;
+    }
+    if ((length < 3) || (payload[0] != WS_STATE_SET)) return false;
+    uint16_t index = payload[1] | (payload[2] << 8);
+    // sets need the index, only subscribed clients have it
+    if ((index >= _count) || (num >= WEBSOCKETS_SERVER_CLIENT_MAX) || (_pending[num] == nullptr)) return true;
+    char value[WS_STATE_VALUE_LENGTH];
+    size_t l = min(length - 3, (size_t)WS_STATE_VALUE_LENGTH - 1);
+    memcpy(value, payload + 3, l);
+    value[l] = '\0';
+    if (_entries[index].property->readOnly()) {
+      LOG->notice(F("WebSocket [%d] set of read only %s.%s ignored"), num, _entries[index].device->id(), _entries[index].id);
+      return true;
+    }
+    LOG->debug(F("WebSocket [%d] set %s.%s to '%s'"), num, _entries[index].device->id(), _entries[index].id, value);
+    _entries[index].property->parse(value);
+    return true;
+  }
+
+  void loop(unsigned long now) {
+    if ((_count == 0) || (now - _lastLoop < _interval)) return;
+    _lastLoop = now;
+    for (byte num = 0; num < WEBSOCKETS_SERVER_CLIENT_MAX; num++) {
+      if ((_pending[num] == nullptr) || (!WebAppSockets::isConnected(num))) continue;
+      byte frames = 0;
+      while ((_indexPending[num]) && (frames < WS_STATE_FRAMES_PER_LOOP) && (_sendIndex(num))) frames++;
+      if (_indexPending[num]) continue;
+      while ((_hasPending(num)) && (frames < WS_STATE_FRAMES_PER_LOOP) && (_sendValues(num))) frames++;
+    }
+  }
+
+ private:
+  WStateEntry* _entries = nullptr;
+  uint16_t _count = 0;
+  uint16_t _words = 0;
+  uint16_t _interval = WS_STATE_INTERVAL;
+  unsigned long _lastLoop = 0;
+  // one bit per property and client
+  uint32_t* _pending[WEBSOCKETS_SERVER_CLIENT_MAX];
+  bool _indexPending[WEBSOCKETS_SERVER_CLIENT_MAX];
+  // the next index entry to send per client
+  uint16_t _indexNext[WEBSOCKETS_SERVER_CLIENT_MAX];
+  // allocated with the first subscription
+  uint8_t* _frame = nullptr;
+
+  void _flagAll(uint8_t num, bool flag) {
+    _indexPending[num] = flag;
+    _indexNext[num] = 0;
+    if (_pending[num] == nullptr) return;
+    memset(_pending[num], (flag ? 0xFF : 0x00), sizeof(uint32_t) * _words);
+    // no bits behind the last property
+    if ((flag) && (_count % 32 != 0)) _pending[num][_words - 1] = (1UL << (_count % 32)) - 1;
+  }
+
+  bool _hasPending(uint8_t num) {
+    for (uint16_t w = 0; w < _words; w++) {
+      if (_pending[num][w] != 0) return true;
+    }
+    return false;
+  }
+
+  bool _isPending(uint8_t num, uint16_t index) { return ((_pending[num][index / 32] & (1UL << (index % 32))) != 0); }
+
+  // Next index frame, false if the client is congested
+  bool _sendIndex(uint8_t num) {
+    uint16_t first = _indexNext[num];
+    size_t length = 0;
+    _frame[length++] = WS_STATE_INDEX;
+    _frame[length++] = first & 0xFF;
+    _frame[length++] = first >> 8;
+    uint16_t i = first;
+    for (; i < _count; i++) {
+      const char* deviceId = _entries[i].device->id();
+      size_t dl = strlen(deviceId);
+      size_t pl = strlen(_entries[i].id);
+      size_t nl = min(dl + 1 + pl, (size_t)255);
+      if (length + 2 + nl > WS_STATE_FRAME_SIZE) break;
+      _frame[length++] = (uint8_t)_entries[i].property->type();
+      _frame[length++] = nl;
+      memcpy(_frame + length, deviceId, min(dl, nl));
+      if (nl > dl) {
+        _frame[length + dl] = '.';
+        memcpy(_frame + length + dl + 1, _entries[i].id, nl - dl - 1);
+      }
+      length += nl;
+    }
+    if (!WebAppSockets::send(num, _frame, length, true)) return false;
+    _indexNext[num] = i;
+    _indexPending[num] = (i < _count);
+    return true;
+  }
+
+  // Next frame with flagged values, false if the client is congested
+  bool _sendValues(uint8_t num) {
+    size_t length = 0;
+    _frame[length++] = WS_STATE_VALUES;
+    uint16_t i = 0;
+    for (; i < _count; i++) {
+      if (!_isPending(num, i)) continue;
+      if (length + 3 > WS_STATE_FRAME_SIZE) break;
+      size_t size = _encode(_entries[i].property->value(), _frame + length + 2, WS_STATE_FRAME_SIZE - length - 2);
+      if (size == 0) break;
+      _frame[length++] = i & 0xFF;
+      _frame[length++] = i >> 8;
+      length += size;
+    }
+    if (!WebAppSockets::send(num, _frame, length, true)) return false;
+    // everything flagged before i is in the frame
+    for (uint16_t j = 0; j < i; j++) _pending[num][j / 32] &= ~(1UL << (j % 32));
+    return true;
+  }
+
+  // Type and value at out. Returns the bytes used, 0 if space is too short
+  static size_t _encode(WValue* value, uint8_t* out, size_t space) {
+    uint8_t type = (uint8_t)value->type();
+    if (value->isNull()) {
+      if (space < 1) return 0;
+      out[0] = type | WS_STATE_NULL;
+      return 1;
+    }
+    size_t size;
+    switch (value->type()) {
+      case WDataType::BOOLEAN:
+      case WDataType::BYTE:
+        size = 1;
+        break;
+      case WDataType::SHORT:
+      case WDataType::UNSIGNED_SHORT:
+        size = 2;
+        break;
+      case WDataType::STRING:
+        size = 1 + min(strlen(value->asString()), (size_t)255);
+        break;
+      case WDataType::BYTE_ARRAY:
+        size = 1 + value->length();
+        break;
+      default:
+        size = 4;
+    }
+    if (1 + size > space) return 0;
+    out[0] = type;
+    uint32_t v = 0;
+    switch (value->type()) {
+      case WDataType::BOOLEAN:
+        v = value->asBool();
+        break;
+      case WDataType::BYTE:
+        v = value->asByte();
+        break;
+      case WDataType::SHORT:
+        v = (uint16_t)value->asShort();
+        break;
+      case WDataType::UNSIGNED_SHORT:
+        v = value->asUnsignedShort();
+        break;
+      case WDataType::INTEGER:
+        v = (uint32_t)value->asInt();
+        break;
+      case WDataType::UNSIGNED_LONG:
+        v = value->asUnsignedLong();
+        break;
+      case WDataType::DOUBLE: {
+        float f = value->asDouble();
+        memcpy(&v, &f, 4);
+        break;
+      }
+      case WDataType::STRING:
+        out[1] = size - 1;
+        memcpy(out + 2, value->asString(), size - 1);
+        return 1 + size;
+      case WDataType::BYTE_ARRAY:
+        out[1] = size - 1;
+        for (byte b = 0; b < size - 1; b++) out[2 + b] = value->byteArrayValue(b);
+        return 1 + size;
+      default:
+        break;
+    }
+    for (byte b = 0; b < size; b++) out[1 + b] = v >> (8 * b);
+    return 1 + size;
+  }
+};
+
+#endif
@@ -124,10 +124,9 @@ class PT2314 : public WI2C{
 
   int volume_to_pt2314(int vol) { return 63 - ((vol * 63) / 100); }
 
+  // Queued at the bus, 0 if there was room
   int writeI2CChar(unsigned char c) {
-    Wire.beginTransmission(PT2314_I2C_ADDRESS);
-    Wire.write(c);
-    return Wire.endTransmission();
+    return (_write(&c, 1) ? I2C_OK : I2C_ERROR_BUSY);
   }
 
   bool _updateVolume() {
@@ -3,13 +3,17 @@
 
 #include "Adafruit_NeoPixel.h"
 #include "WGpio.h"
+#include "WLedEffects.h"
 
 #define COLOR_DEFAULT 0x200000
 #define COLOR_OFF 0x000000
 #define BLINK_MILLIS 300
+// color pickers are polled at this interval
+#define LED_POLL_MILLIS 100
 const static char WRGB_NUMBER_OF_LEDS[] PROGMEM = "leds";
-const int COUNT_LED_PROGRAMS = 3;
-const float PI180 = 0.01745329;
+const int COUNT_LED_PROGRAMS = 6;
+// set in the stored rgb mode; older firmware stored 0..2 without it and showed fixed colors for all
+#define LED_MODE_STORED 0x80
 const neoPixelType LED_TYPE_WS2812 = NEO_GRB + NEO_KHZ800;
 const neoPixelType LED_TYPE_PL9823 = NEO_RGB + NEO_KHZ800;
 
@@ -17,8 +21,6 @@ class W2812Led : public WGpio {
  public:
   typedef std::function<uint32_t()> TColorPicker;
   W2812Led(WGpioType gpioType = GPIO_TYPE_RGB_WS2812, int ledPin = NO_PIN, byte numberOfLeds = 0) : WGpio(gpioType, ledPin) {
-    _programStatusCounter = 0;
-    _lastUpdate = 0;
     _color = new WColorProperty("Color", 255, 0, 0);
     _colors = new uint32_t[numberOfLeds];
     _alwaysOn = new bool[numberOfLeds];
@@ -34,7 +36,11 @@ class W2812Led : public WGpio {
     _brightness = new WRangeProperty("Brightness", WDataType::INTEGER, WValue::ofInt(10), WValue::ofInt(255), TYPE_LEVEL_PROPERTY);
     _brightness->asInt(160);
     // network->getSettings()->add(this->brightness);
-    _brightness->addListener([this]() { _strip->setBrightness(_brightness->asInt()); });
+    _levels.brightness(_brightness->asInt());
+    _brightness->addListener([this]() {
+      _levels.brightness(_brightness->asInt());
+      _needsUpdate = true;
+    });
     this->numberOfLeds(numberOfLeds);
   }
 
@@ -49,6 +55,9 @@ class W2812Led : public WGpio {
     delete[] _colors;
     delete[] _alwaysOn;
     delete[] _blinking;
+    if (_effect) delete _effect;
+    if (_frame) delete[] _frame;
+    if (_pixels) delete[] _pixels;
     if (_strip) delete _strip;
   }
 
@@ -56,6 +65,7 @@ class W2812Led : public WGpio {
     if (!WGpio::isOn()) {
       for (int i = 0; i < _strip->numPixels(); i++) {
         _strip->setPixelColor(i, _strip->Color(0, 0, 0));
+        _pixels[i] = COLOR_OFF;
       }
       _strip->show();
     }
@@ -75,6 +85,12 @@ class W2812Led : public WGpio {
 
   const char* modeTitle(byte index) {
     switch (index) {
+      case 5:
+        return "Chase";
+      case 4:
+        return "Wipe";
+      case 3:
+        return "Pulse";
       case 2:
         return "Rainbow";
       case 1:
@@ -84,15 +100,15 @@ class W2812Led : public WGpio {
     }
   }
 
-  byte rgbMode() { return _rgbMode->asByte(); }
+  byte rgbMode() { return (_rgbMode->asByte() & ~LED_MODE_STORED); }
 
   void setRgbMode(byte rgbMode) {
     if (rgbMode >= COUNT_LED_PROGRAMS) {
       rgbMode = 0;
     }
-    if (_rgbMode->asByte() != rgbMode) {
-      _rgbMode->asByte(rgbMode);
-      _programStatusCounter = 0;
+    if (this->rgbMode() != rgbMode) {
+      _rgbMode->asByte(rgbMode | LED_MODE_STORED);
+      _createEffect();
       if (_settingsRegistered) SETTINGS->save();
     }
   }
@@ -147,6 +163,7 @@ class W2812Led : public WGpio {
     WGpio::registerSettings();
     SETTINGS->add(_numberOfLeds, nullptr);
     SETTINGS->add(_rgbMode, nullptr);
+    if ((_rgbMode->asByte() & LED_MODE_STORED) == 0) _rgbMode->asByte(LED_MODE_STORED);
     _onChange();
   }
 
@@ -189,6 +206,12 @@ class W2812Led : public WGpio {
     return this;
   }
 
+  // Interval in ms, at which the color pickers are called
+  W2812Led* pollInterval(unsigned long pollInterval) {
+    _pollInterval = pollInterval;
+    return this;
+  }
+
   W2812Led* onFor(unsigned short onFor) {
     _onFor = onFor;
     _needsUpdate = true;
@@ -209,83 +232,45 @@ class W2812Led : public WGpio {
     if ((_onFor != 0) && (isOnSince(_onFor))) {
       on(false);
     }
+    if (_strip == nullptr) return;
     bool ison = WGpio::isOn();
-    for (byte i = 0; i < _numberOfLeds->asByte(); i++) {
-      if ((ison) || (_alwaysOn[i])) {
-        uint32_t newColor = _colors[i];
+    if ((ison) && (_effect != nullptr)) {
+      // one rendered frame per LED_FRAME_MILLIS
+      if ((_needsUpdate) || (now - _lastFrame >= LED_FRAME_MILLIS)) {
+        _effect->color(WLedEffect::rgb(_color->red(), _color->green(), _color->blue()));
+        _effect->render(_frame, numberOfLeds(), now);
+        _levels.apply(_frame, numberOfLeds(), true);
+        _show();
+        _lastFrame = now;
+        _needsUpdate = false;
+      }
+      return;
+    }
+    if ((_needsUpdate) || (now - _lastPoll >= _pollInterval)) {
+      for (byte i = 0; i < numberOfLeds(); i++) {
         if (_conditions[i]) {
-          newColor = _conditions[i]();
+          uint32_t newColor = _conditions[i]();
           _needsUpdate = _needsUpdate || (newColor != _colors[i]);
           _colors[i] = newColor;
         }
-        if (_blinking[i]) {
-          if ((_lastBlinkOn == 0) || (now - _lastBlinkOn > BLINK_MILLIS)) {
-            _blinkOn = !_blinkOn;
-            _lastBlinkOn = now;
-            _needsUpdate = true;
-          }
-          if (!_blinkOn) newColor = COLOR_OFF;
-        }
-        _strip->setPixelColor(i, newColor);
+      }
+      _lastPoll = now;
+    }
+    // all blinking leds share the phase
+    bool blinkOn = ((now / BLINK_MILLIS) % 2 == 1);
+    _needsUpdate = _needsUpdate || (blinkOn != _blinkOn);
+    _blinkOn = blinkOn;
+    if (!_needsUpdate) return;
+    uint32_t blinkMask = (blinkOn ? 0xFFFFFFFF : 0);
+    for (byte i = 0; i < numberOfLeds(); i++) {
+      if ((ison) || (_alwaysOn[i])) {
+        _frame[i] = _levels.linear(_colors[i] & (_blinking[i] ? blinkMask : 0xFFFFFFFF));
       } else {
-        _strip->setPixelColor(i, COLOR_OFF);
+        _frame[i] = COLOR_OFF;
       }
     }
-    if (_needsUpdate) _strip->show();
+    _show();
     _needsUpdate = false;
-
-    if (WGpio::isOn()) {
-      /*if (now - _lastUpdate > 200) {
-        switch (rgbMode()) {
-          case 0: {
-            // Pulsing RGB color
-            float t = sin((_programStatusCounter - 90) * PI180);
-            t = (t + 1) / 2;
-            uint32_t pulseColor = _strip->Color(
-                round(_color->red() * (85 + round(170.0 * t)) / 255),
-                round(_color->green() * (85 + round(170.0 * t)) / 255),
-                round(_color->blue() * (85 + round(170.0 * t)) / 255));
-            for (uint16_t rainbowI = 0; rainbowI < _strip->numPixels();
-                 rainbowI++) {
-              _strip->setPixelColor(rainbowI, pulseColor);
-            }
-            _strip->show();
-            _programStatusCounter++;
-            if (_programStatusCounter >= 360) {
-              _programStatusCounter = 0;
-            }
-            break;
-          }
-          case 1: {
-            // Rainbow program, all pixel the same color
-            uint32_t wC = wheelColor((_programStatusCounter)&255);
-            for (uint16_t rainbowI = 0; rainbowI < _strip->numPixels();
-                 rainbowI++) {
-              _strip->setPixelColor(rainbowI, wC);
-            }
-            _strip->show();
-            _programStatusCounter++;
-            if (_programStatusCounter == 256 * 5) {
-              _programStatusCounter = 0;
-            }
-            break;
-          }
-          case 2: {
-            // Rainbow program, different colors
-            for (uint16_t rainbowI = 0; rainbowI < _strip->numPixels(); rainbowI++) {
-              _strip->setPixelColor(rainbowI, wheelColor(((rainbowI * 256 / _strip->numPixels()) + _programStatusCounter) & 255));
-            }
-            _strip->show();
-            _programStatusCounter++;
-            if (_programStatusCounter == 256 * 5) {
-              _programStatusCounter = 0;
-            }
-            break;
-          }
-        }
-        _lastUpdate = now;
-      }*/
-    }
   }
 
  protected:
@@ -302,20 +287,70 @@ class W2812Led : public WGpio {
     }
     if (isInitialized()) {
       _strip = new Adafruit_NeoPixel(numberOfLeds(), pin(), (type() == GPIO_TYPE_RGB_WS2812 ? LED_TYPE_WS2812 : LED_TYPE_PL9823));
-      _strip->begin();                              // INITIALIZE NeoPixel strip object (REQUIRED)
-      _strip->show();                               // Turn OFF all pixels ASAP
-      _strip->setBrightness(_brightness->asInt());  // Set BRIGHTNESS to about 1/5 (max = 255)
+      _strip->begin();  // INITIALIZE NeoPixel strip object (REQUIRED)
+      _strip->show();   // Turn OFF all pixels ASAP
+      // brightness is applied by _levels, setBrightness of the strip would change the stored colors
+    }
+    if (_frame) delete[] _frame;
+    _frame = new uint32_t[numberOfLeds()];
+    if (_pixels) delete[] _pixels;
+    _pixels = new uint32_t[numberOfLeds()];
+    // a new strip is dark
+    WLedEffect::fill(_pixels, numberOfLeds(), COLOR_OFF);
+    _createEffect();
+  }
+
+  // Writes the pixels of the frame that differ from the strip, shows only if there are any
+  void _show() {
+    bool changed = false;
+    for (byte i = 0; i < numberOfLeds(); i++) {
+      if (_frame[i] != _pixels[i]) {
+        _pixels[i] = _frame[i];
+        _strip->setPixelColor(i, _frame[i]);
+        changed = true;
+      }
+    }
+    if (changed) _strip->show();
+  }
+
+  // Effect of the rgb mode, nullptr for fixed colors
+  void _createEffect() {
+    if (_effect) delete _effect;
+    switch (rgbMode()) {
+      case 1:
+        _effect = new WRainbowEffect(false);
+        break;
+      case 2:
+        _effect = new WRainbowEffect(true);
+        break;
+      case 3:
+        _effect = new WPulseEffect();
+        break;
+      case 4:
+        _effect = new WWipeEffect();
+        break;
+      case 5:
+        _effect = new WChaseEffect();
+        break;
+      default:
+        _effect = nullptr;
     }
+    if (_effect) _effect->start(millis());
+    _needsUpdate = true;
   }
 
  private:
   WValue* _numberOfLeds = new WValue(WDataType::BYTE);
-  WValue* _rgbMode = new WValue((byte)2);
+  WValue* _rgbMode = new WValue((byte)LED_MODE_STORED);
   Adafruit_NeoPixel* _strip = nullptr;
-  int _programStatusCounter;
+  WLedEffect* _effect = nullptr;
+  // next frame and the colors currently on the strip
+  uint32_t* _frame = nullptr;
+  uint32_t* _pixels = nullptr;
+  unsigned long _lastFrame = 0;
   WColorProperty* _color;
   WRangeProperty* _brightness;
-  unsigned long _lastUpdate;
+  WLedLevels _levels;
   bool _needsUpdate = false;
   uint32_t* _colors;
   bool* _alwaysOn;
@@ -323,64 +358,8 @@ class W2812Led : public WGpio {
   bool* _blinking;
   unsigned short _onFor = 0;
   bool _blinkOn = false;
-  unsigned long _lastBlinkOn = 0;
-
-  uint32_t wheelColor(byte wheelPos) {
-    byte c;
-    if (wheelPos < 85) {
-      c = wheelPos * 3;
-      return _strip->Color(c, 255 - c, 0);
-    } else if (wheelPos < 170) {
-      // wheelPos -= 85;
-      c = (wheelPos - 85) * 3;
-      return _strip->Color(255 - c, 0, c);
-    } else {
-      // wheelPos -= 170;
-      c = (wheelPos - 170) * 3;
-      return _strip->Color(0, c, 255 - c);
-    }
-  }
-
-  void whiteOverRainbow(int whiteSpeed, int whiteLength) {
-    if (whiteLength >= _strip->numPixels()) whiteLength = _strip->numPixels() - 1;
-
-    int head = whiteLength - 1;
-    int tail = 0;
-    int loops = 3;
-    int loopNum = 0;
-    uint32_t lastTime = millis();
-    uint32_t firstPixelHue = 0;
-
-    for (;;) {  // Repeat forever (or until a 'break' or 'return')
-      for (int i = 0; i < _strip->numPixels();
-           i++) {                            // For each pixel in strip...
-        if (((i >= tail) && (i <= head)) ||  //  If between head & tail...
-            ((tail > head) && ((i >= tail) || (i <= head)))) {
-          _strip->setPixelColor(i, _strip->Color(0, 0, 0, 255));  // Set white
-        } else {                                                  // else set rainbow
-          int pixelHue = firstPixelHue + (i * 65536L / _strip->numPixels());
-          _strip->setPixelColor(i, _strip->gamma32(_strip->ColorHSV(pixelHue)));
-        }
-      }
-
-      _strip->show();  // Update strip with new contents
-      // There's no delay here, it just runs full-tilt until the timer and
-      // counter combination below runs out.
-
-      firstPixelHue += 40;  // Advance just a little along the color wheel
-
-      if ((millis() - lastTime) > whiteSpeed) {  // Time to update head/tail?
-        if (++head >= _strip->numPixels()) {     // Advance head, wrap around
-          head = 0;
-          if (++loopNum >= loops) return;
-        }
-        if (++tail >= _strip->numPixels()) {  // Advance tail, wrap around
-          tail = 0;
-        }
-        lastTime = millis();  // Save time of last movement
-      }
-    }
-  }
+  unsigned long _pollInterval = LED_POLL_MILLIS;
+  unsigned long _lastPoll = 0;
 };
 
 #endif
@@ -1,16 +1,14 @@
 #ifndef W_DIMMER_H
 #define W_DIMMER_H
 
-#define LEVEL_STEPS 5
-
 #include "WGpio.h"
+#include "WFade.h"
 
 class WDimmer: public WGpio {
 public:
 	WDimmer(WGpioType gpioType, byte pin, uint8_t mode = OUTPUT)
 			: WGpio(gpioType, pin, mode) {						
 		_levelCurrent = 0;
-		_stopLevelAdjusting();		
 	}
 
 	virtual ~WDimmer() {
@@ -19,21 +17,11 @@ public:
 
 	virtual void loop(unsigned long now) {
 		WGpio::loop(now);			
-		if ((this->isInitialized()) && (_levelAdjusting) && ((_levelLastUpdate == 0) || (_levelLastUpdate + 200 < now))) {			
-			int targetLevel = (isOn() ? (_level != nullptr ? _level->asInt() : 100) : 0);
-			if (targetLevel != _levelCurrent) {
-				if (_levelStep == 0) {
-					_levelStep = (targetLevel - _levelCurrent) / LEVEL_STEPS;					
-				}
-				_levelCurrent += _levelStep;
-				_writeLevelCurrent(_levelCurrent);
-				if (((_levelStep >= 0) && (_levelCurrent >= targetLevel)) || ((_levelStep < 0) && (_levelCurrent <= targetLevel))) {
-					_stopLevelAdjusting();	
-				}
-			} else {
-				_stopLevelAdjusting();
+		if ((this->_isInitialized()) && (_fade.isRunning())) {
+			uint16_t levelCurrent = _fade.value(now);
+			if (levelCurrent != _levelCurrent) {
+				_writeLevelCurrent(levelCurrent);
 			}
-			_levelLastUpdate = now;
 		}
 	}
 
@@ -47,15 +35,24 @@ public:
 		return this;
 	}  
 
+	// Duration of a fade in ms, 0 switches immediately
+	WDimmer* fadeDuration(unsigned long fadeDuration) {
+		_fade.duration(fadeDuration);
+		return this;
+	}
+
+	WDimmer* fadeCurve(WFadeCurve fadeCurve) {
+		_fade.curve(fadeCurve);
+		return this;
+	}
+
 protected:
 	WValue* _level = new WValue((byte) 100);
-
-	bool _levelAdjusting;
-	int _levelStep;
-	int _levelCurrent;
-	unsigned long _levelLastUpdate;
+	WFade _fade;
+	// output, 0..FADE_MAX
+	uint16_t _levelCurrent;
 	
-	virtual void _writeLevelCurrent(int levelCurrent) {
+	virtual void _writeLevelCurrent(uint16_t levelCurrent) {
 		_levelCurrent = levelCurrent;
 	}
 
@@ -64,16 +61,10 @@ protected:
 		_updateLevel();
   };
 
+	// Fades from the current level to the level in percent, 0 if off
 	void _updateLevel() {
-		_levelAdjusting = true;
-		_levelStep = 0;
-		_levelLastUpdate = 0;
-
-	}
-
-	void _stopLevelAdjusting() {
-		_updateLevel();
-		_levelAdjusting = false;		
+		uint32_t targetLevel = (isOn() ? (_level != nullptr ? _level->asByte() : 100) : 0);
+		_fade.to(targetLevel * FADE_MAX / 100, millis());
 	}
 
 private:
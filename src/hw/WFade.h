@@ -0,0 +1,98 @@
+#ifndef W_FADE_H
+#define W_FADE_H
+
+#include <Arduino.h>
+
+#define FADE_MAX 0xFFFF
+#define FADE_MILLIS 1000
+// curve tables have FADE_TABLE_STEPS + 1 points, values in between are interpolated
+#define FADE_TABLE_STEPS 64
+
+enum WFadeCurve { FADE_LINEAR, FADE_EASE_IN_OUT, FADE_CIE };
+
+// Smoothstep 3t^2 - 2t^3, slow start and end
+const uint16_t FADE_EASE_IN_OUT_TABLE[FADE_TABLE_STEPS + 1] PROGMEM = {
+    0, 47, 188, 418, 736, 1137, 1620, 2180, 2816, 3523, 4300, 5142, 6048,
+    7013, 8036, 9112, 10240, 11415, 12636, 13898, 15200, 16537, 17908, 19308, 20736, 22187,
+    23660, 25150, 26656, 28173, 29700, 31232, 32768, 34303, 35835, 37362, 38879, 40385, 41875,
+    43348, 44799, 46227, 47627, 48998, 50335, 51637, 52899, 54120, 55295, 56423, 57499, 58522,
+    59487, 60393, 61235, 62012, 62719, 63355, 63915, 64398, 64799, 65117, 65347, 65488, 65535};
+
+// CIE 1931 lightness to luminance, steps look even to the eye
+const uint16_t FADE_CIE_TABLE[FADE_TABLE_STEPS + 1] PROGMEM = {
+    0, 113, 227, 340, 453, 567, 686, 821, 972, 1141, 1328, 1535, 1762,
+    2010, 2281, 2575, 2894, 3237, 3607, 4004, 4429, 4883, 5367, 5882, 6429, 7009,
+    7623, 8272, 8956, 9677, 10436, 11234, 12071, 12948, 13868, 14830, 15835, 16885, 17980,
+    19121, 20310, 21547, 22833, 24170, 25558, 26997, 28490, 30037, 31639, 33297, 35012, 36785,
+    38616, 40507, 42460, 44473, 46550, 48690, 50895, 53166, 55503, 57907, 60380, 62922, 65535};
+
+/*
+  Fades a level from its current value to a target over a fixed duration.
+  The level only depends on now, so a fade takes the same time however often
+  value() is called. A new target starts from the level reached so far.
+  Levels and values are 0..FADE_MAX. With FADE_CIE the level is lightness
+  and value() the luminance to output.
+*/
+class WFade {
+ public:
+  WFade(WFadeCurve curve = FADE_LINEAR, unsigned long duration = FADE_MILLIS) {
+    _curve = curve;
+    _duration = duration;
+  }
+
+  WFadeCurve curve() { return _curve; }
+
+  void curve(WFadeCurve curve) { _curve = curve; }
+
+  unsigned long duration() { return _duration; }
+
+  // Duration of a fade in ms, 0 jumps to the target
+  void duration(unsigned long duration) { _duration = duration; }
+
+  uint16_t target() { return _target; }
+
+  bool isRunning() { return _running; }
+
+  void to(uint16_t target, unsigned long now) {
+    _from = level(now);
+    _target = target;
+    _startTime = now;
+    _running = true;
+  }
+
+  uint16_t level(unsigned long now) {
+    if (!_running) return _target;
+    unsigned long elapsed = now - _startTime;
+    if (elapsed >= _duration) return _target;
+    uint32_t progress = ((uint64_t)elapsed << 16) / _duration;
+    if (_curve == FADE_EASE_IN_OUT) progress = _lookup(FADE_EASE_IN_OUT_TABLE, progress);
+    return _from + (((int64_t)_target - _from) * progress >> 16);
+  }
+
+  // Output at now, ends the fade when the target is reached
+  uint16_t value(unsigned long now) {
+    uint16_t l = level(now);
+    if ((_running) && (now - _startTime >= _duration)) _running = false;
+    return (_curve == FADE_CIE ? _lookup(FADE_CIE_TABLE, l) : l);
+  }
+
+ private:
+  WFadeCurve _curve;
+  unsigned long _duration;
+  uint16_t _from = 0;
+  uint16_t _target = 0;
+  unsigned long _startTime = 0;
+  bool _running = false;
+
+  // Table value at x (0..FADE_MAX), linear between the points
+  static uint16_t _lookup(const uint16_t* table, uint32_t x) {
+    uint32_t position = x * FADE_TABLE_STEPS;
+    uint16_t i = position / FADE_MAX;
+    if (i >= FADE_TABLE_STEPS) return pgm_read_word(&table[FADE_TABLE_STEPS]);
+    uint32_t a = pgm_read_word(&table[i]);
+    uint32_t b = pgm_read_word(&table[i + 1]);
+    return a + (b - a) * (position % FADE_MAX) / FADE_MAX;
+  }
+};
+
+#endif
@@ -34,75 +34,35 @@ public:
 
 	virtual void loop(unsigned long now) {
 		WI2CTemperature::loop(now);		
-		if (_state == STATE_IDLE) {			
+		if (_pending) {
+			// request or read queued at the bus
+		} else if (_state == STATE_IDLE) {			
 			if ((_lastMeasure == 0) || (now - _lastMeasure > (unsigned long)(_measureInterval))) {
 				//start measurement
 				_lastMeasure = now;
 				_reset();    
-				_request(now, TRIGGER_TEMP_MEASURE_NOHOLD, STATE_READ_TEMPERATURE);				
+				_request(TRIGGER_TEMP_MEASURE_NOHOLD, STATE_READ_TEMPERATURE);				
 			}
 		} else if ((_state == STATE_READ_TEMPERATURE_PAUSED) || (_state == STATE_READ_HUMIDITY_PAUSED)) {
 			if (now - _lastRequest > I2C_BETWEEN) {
 				//Restart measurement
 				if (_state == STATE_READ_TEMPERATURE_PAUSED) {			
-					_request(now, TRIGGER_TEMP_MEASURE_NOHOLD, STATE_READ_TEMPERATURE);
+					_request(TRIGGER_TEMP_MEASURE_NOHOLD, STATE_READ_TEMPERATURE);
 				} else if (_state == STATE_READ_HUMIDITY_PAUSED) {
-					_request(now, TRIGGER_HUMD_MEASURE_NOHOLD, STATE_READ_HUMIDITY);						
+					_request(TRIGGER_HUMD_MEASURE_NOHOLD, STATE_READ_HUMIDITY);						
 				}	
 			}	
-		} else {								
-  		if ((now - _lastRequest > I2C_REQUEST_TO_RESULT) && (_i2cPort->requestFrom(HTU21D_ADDRESS, 3) == 3)) {
-				//There is a result
-				byte msb, lsb, checksum;
-  			msb = _i2cPort->read();
-  			lsb = _i2cPort->read();
-  			checksum = _i2cPort->read();
-  			uint16_t rawValue = ((uint16_t) msb << 8) | (uint16_t) lsb;
-  			if (_checkCRC(rawValue, checksum) == 0) {
-					//Everything fine
-					rawValue = rawValue & 0xFFFC; // Zero out the status bits
-					if (_state == STATE_READ_TEMPERATURE) {
-						double t = rawValue * (175.72 / 65536.0) - 46.85;
-						_temperatureValue = _temperatureValue + t;												
-						_counter++;
-						_lastMeasure = now;
-						if (_counter < HTU21D_AVERAGE_COUNTS) {														
-							_state = STATE_READ_TEMPERATURE_PAUSED;
-						} else {
-							_temperatureValue = _temperatureValue / (double) HTU21D_AVERAGE_COUNTS;							
-							if (hasProperty()) {
-								property()->asDouble(_temperatureValue + _correctionTemperature);
-							}
-							_counter = 0;
-							_request(now, TRIGGER_HUMD_MEASURE_NOHOLD, STATE_READ_HUMIDITY);
-						}		
-					} else if (_state == STATE_READ_HUMIDITY) {
-						double h = rawValue * (125.0 / 65536.0) - 6.0;
-						_humidityValue = _humidityValue + h;												
-						_counter++;
-						_lastMeasure = now;
-						if (_counter < HTU21D_AVERAGE_COUNTS) {														
-							_state = STATE_READ_HUMIDITY_PAUSED;
-						} else {
-							_humidityValue = _humidityValue / (double) HTU21D_AVERAGE_COUNTS;
-							if (hasHumidity()) {
-								humidity()->asDouble(_humidityValue + _correctionHumidity);
-							}
-							_reset();
-							_lastError = ERROR_NONE;
-						}		
-					}	
-				} else {
-					//Checksum error
-					_reset();
-					_lastError = ERROR_BAD_CRC;
-				}
-			} else if (now - _lastRequest > I2C_TIMEOUT) {
-				//Timeout
-				_reset();
-				_lastError = ERROR_I2C_TIMEOUT;
-			}
-		}		
+		} else if (now - _lastRequest > I2C_TIMEOUT) {
+			//Timeout
+			_reset();
+			_lastError = ERROR_I2C_TIMEOUT;
+		} else if (now - _lastRequest > I2C_REQUEST_TO_RESULT) {
+			_pending = _read(3, [this](byte error, const uint8_t* data, byte length) {
+				_pending = false;
+				// without result, it's read again until timeout
+				if (length == 3) _result(data);
+			});
+		}
 	}
 
 	void _reset() {
@@ -113,14 +73,64 @@ public:
 		_humidityValue = 0.0;
 	}
 
-	void _request(unsigned long now, byte cmd, WHtu21DState followUpState) {
-		_i2cPort->beginTransmission(HTU21D_ADDRESS);		
-		_i2cPort->write(cmd);
-		_i2cPort->endTransmission();
+	void _request(byte cmd, WHtu21DState followUpState) {
 		_state = followUpState;
-		_lastRequest = now;
+		_lastRequest = millis();
+		_pending = _write(&cmd, 1, [this](byte error, const uint8_t* data, byte length) {
+			_pending = false;
+			_lastRequest = millis();
+		});
 	}	
 
+	void _result(const uint8_t* data) {
+		byte msb = data[0], lsb = data[1], checksum = data[2];
+		uint16_t rawValue = ((uint16_t) msb << 8) | (uint16_t) lsb;
+		if (_checkCRC(rawValue, checksum) == 0) {
+			//Everything fine
+			rawValue = rawValue & 0xFFFC; // Zero out the status bits
+			if (_state == STATE_READ_TEMPERATURE) {
+				double t = rawValue * (175.72 / 65536.0) - 46.85;
+				_temperatureValue = _temperatureValue + t;												
+				_counter++;
+				_lastMeasure = millis();
+				if (_counter < HTU21D_AVERAGE_COUNTS) {														
+					_state = STATE_READ_TEMPERATURE_PAUSED;
+				} else {
+					_temperatureValue = _temperatureValue / (double) HTU21D_AVERAGE_COUNTS;							
+					if (hasProperty()) {
+						property()->asDouble(_temperatureValue + _correctionTemperature);
+					}
+					_counter = 0;
+					_request(TRIGGER_HUMD_MEASURE_NOHOLD, STATE_READ_HUMIDITY);
+				}		
+			} else if (_state == STATE_READ_HUMIDITY) {
+				double h = rawValue * (125.0 / 65536.0) - 6.0;
+				_humidityValue = _humidityValue + h;												
+				_counter++;
+				_lastMeasure = millis();
+				if (_counter < HTU21D_AVERAGE_COUNTS) {														
+					_state = STATE_READ_HUMIDITY_PAUSED;
+				} else {
+					_humidityValue = _humidityValue / (double) HTU21D_AVERAGE_COUNTS;
+					if (hasHumidity()) {
+						humidity()->asDouble(_humidityValue + _correctionHumidity);
+					}
+					_reset();
+					_lastError = ERROR_NONE;
+				}		
+			}	
+		} else {
+			//Checksum error
+			_reset();
+			_lastError = ERROR_BAD_CRC;
+		}
+	}
+
+	virtual unsigned long nextLoop(unsigned long now) {
+		// between measurements nothing to do
+		return ((_state == STATE_IDLE) && (!_pending) && (_lastMeasure != 0) ? _lastMeasure + _measureInterval + 1 : now);
+	}
+
 	WProperty* humidity() { return _humidity; }
 
   void setHumidity(WProperty* humidity) {
@@ -156,6 +166,7 @@ private:
 	double _temperatureValue, _humidityValue;
 	WHtu21DState _state;
 	byte _counter;
+	bool _pending = false;
 	double _correctionTemperature, _correctionHumidity;
 
 	byte _checkCRC(uint16_t message_from_sensor, uint8_t check_value_from_sensor) {  	
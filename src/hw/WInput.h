@@ -23,19 +23,29 @@ class WInput : public WGpio {
 
   void loop(unsigned long now) {
     if (_isInitialized()) {
-      // 1. Eliminate flickering input
-      bool newOn = (readInput(pin()) == _onLevel());
-      if (newOn != isOn()) {
-        if (_startTime == 0) {
-          _startTime = now;
-        } else if ((_startTime > 0) && (now - _startTime >= (newOn ? _onDelay : _offDelay))) {
-          _startTime = 0;
-          on(newOn);
+      if (_edges != nullptr) {
+        // replay the recorded edges at their time, input kept its level until each edge
+        WEdge edge;
+        while (_edges->pop(edge)) {
+          _sample(_level, edge.time);
+          _level = bitRead(edge.level, 0);
+          _sample(_level, edge.time);
         }
+        if (_edges->overflowed()) _level = readInput(pin());
       } else {
-        _startTime = 0;
+        _level = readInput(pin());
       }
+      _sample(_level, now);
+    }
+  }
+
+  // Pin change interrupt instead of polling, not possible with expanders
+  WInput* useInterrupt(bool useInterrupt) {
+    _useEdges(useInterrupt);
+    if (_isInitialized()) {
+      _level = readInput(pin());
     }
+    return this;
   }
 
   bool inverted() { return bitRead(_config->asByte(), BIT_CONFIG_INVERTED); }
@@ -84,6 +94,21 @@ class WInput : public WGpio {
 
   byte _offLevel() { return !_onLevel(); }
 
+  // Eliminates flickering input: level must be stable for on or off delay
+  void _sample(bool level, unsigned long now) {
+    bool newOn = (level == _onLevel());
+    if (newOn != isOn()) {
+      if (_startTime == 0) {
+        _startTime = now;
+      } else if ((_startTime > 0) && (now - _startTime >= (newOn ? _onDelay : _offDelay))) {
+        _startTime = 0;
+        on(newOn);
+      }
+    } else {
+      _startTime = 0;
+    }
+  }
+
   virtual void _updateOn() {
     if (property() != nullptr) {
       property()->readOnly(false);
@@ -94,6 +119,7 @@ class WInput : public WGpio {
 
  private:
   unsigned long _startTime = 0;
+  bool _level = false;
   u_int16_t _onDelay = 20;
   u_int16_t _offDelay = 20;
 
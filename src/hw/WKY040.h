@@ -3,10 +3,6 @@
 
 #include "WSwitch.h"
 
-class WKY040;
-static void _addJog(WKY040 *jog);
-static void _jogEventHandler(void);
-
 class WKY040 : public WSwitch {
  public:
   WKY040(int pinSwitch, int pinClk, int pinDt, bool inverted = false, IWExpander *expander = nullptr)
@@ -16,11 +12,12 @@ class WKY040 : public WSwitch {
     mode(_pinClk, (inverted ? INPUT_PULLUP : INPUT));
     mode(_pinDt, (inverted ? INPUT_PULLUP : INPUT));    
     _irqEventLeft = _irqEventRight = false;
-    _useInterrupt = (expander == nullptr);
+    _useInterrupt = ((expander == nullptr) && (_pinClk != NO_PIN) && (_pinDt != NO_PIN));
     supportLongPress(true);
     if (_useInterrupt) {
-      _addJog(this);
-      attachInterrupt(_pinClk, _jogEventHandler, (inverted ? FALLING : RISING));
+      // clk edges with the level of dt at that time
+      _clkEdges = new WEdgeBuffer(_pinClk, _pinDt);
+      _clkEdges->attach(inverted ? FALLING : RISING);
     }
     _rotatingLeft = nullptr;
     _rotatingRight = nullptr;
@@ -29,35 +26,24 @@ class WKY040 : public WSwitch {
     }    
   }
 
+  virtual ~WKY040() {
+    if (_clkEdges) delete _clkEdges;
+  }
+
   void loop(unsigned long now) {
     WSwitch::loop(now);    
-
-    bool clk = (!_useInterrupt ? readInput(_pinClk) : !_onLevel());
-    if ((_irqEventLeft) || (_irqEventRight) || ((_lastClk != _onLevel()) && (clk == _onLevel()))) {      
-      if (!_useInterrupt) {        
-        bool dt = readInput(_pinDt);        
-        _irqEventLeft = (dt == clk);
-        _irqEventRight = !_irqEventLeft;
-      }
-      if (inverted()) {
-        _irqEventLeft = !_irqEventLeft;
-        _irqEventRight = !_irqEventRight;
+    if (_useInterrupt) {
+      WEdge edge;
+      while (_clkEdges->pop(edge)) {
+        _rotated((bitRead(edge.level, 1) == bitRead(edge.level, 0)), edge.time);
       }
-      if ((_lastJogEvent == 0) || (now - _lastJogEvent >= _jogSensitiveness)) {
-        this->handleButtonOrSwitchPressed();
-      }     
-      _lastJogEvent = now; 
-      
-      if (_rotatingLeft != nullptr) {
-        _rotatingLeft->asBool(_irqEventLeft);
+    } else {
+      bool clk = readInput(_pinClk);
+      if ((_lastClk != _onLevel()) && (clk == _onLevel())) {
+        _rotated((readInput(_pinDt) == clk), now);
       }
-      if (_rotatingRight != nullptr) {
-        _rotatingRight->asBool(!_irqEventRight);
-      };
+      _lastClk = clk;
     }
-    _irqEventLeft = false;
-    _irqEventRight = false;
-    _lastClk = clk;
   }
 
   void rotatingLeft(WProperty *rotatingLeft) {
@@ -82,28 +68,31 @@ class WKY040 : public WSwitch {
  private:
   WProperty *_rotatingLeft;
   WProperty *_rotatingRight;
+  WEdgeBuffer *_clkEdges = nullptr;
   bool _lastClk;
   unsigned long _jogSensitiveness = 100;
   unsigned long _lastJogEvent = 0;
-};
-
-WList<WKY040> *_jogs = nullptr;
 
-static void _addJog(WKY040 *jog) {
-    if (_jogs == nullptr) {
-        _jogs = new WList<WKY040>();
+  void _rotated(bool left, unsigned long now) {
+    _irqEventLeft = left;
+    _irqEventRight = !left;
+    if (inverted()) {
+      _irqEventLeft = !_irqEventLeft;
+      _irqEventRight = !_irqEventRight;
     }
-    _jogs->add(jog);
-}
-
-static void _jogEventHandler(void) {
-    if (_jogs != nullptr) {
-        _jogs->forEach([](int index, WKY040 *jog, const char* id) { 
-          bool clk = digitalRead(jog->_pinClk);
-          jog->_irqEventLeft = (digitalRead(jog->_pinDt) == clk);
-          jog->_irqEventRight = !jog->_irqEventLeft;          
-        });
+    if ((_lastJogEvent == 0) || (now - _lastJogEvent >= _jogSensitiveness)) {
+      this->handleButtonOrSwitchPressed();
+    }     
+    _lastJogEvent = now; 
+    if (_rotatingLeft != nullptr) {
+      _rotatingLeft->asBool(_irqEventLeft);
+    }
+    if (_rotatingRight != nullptr) {
+      _rotatingRight->asBool(!_irqEventRight);
     }
-}
+    _irqEventLeft = false;
+    _irqEventRight = false;
+  }
+};
 
-#endif
\ No newline at end of file
+#endif
@@ -32,10 +32,16 @@ class WLed : public WGpio {
     }
     _blinkMillis = blinkMillis;
     WGpio::on(ledOn);
+    wakeUp();
   }
 
   bool isBlinking() { return (_blinkMillis > 0); }
 
+  virtual unsigned long nextLoop(unsigned long now) {
+    // output is only toggled while blinking, otherwise it's set by the loop after on()
+    return ((WGpio::isOn()) && (isBlinking()) ? _lastBlinkOn + _blinkMillis + 1 : now + SCHEDULER_MAX_IDLE);
+  }
+
   void loop(unsigned long now) {
     if (WGpio::isOn()) {
       if (isBlinking()) {
@@ -58,6 +64,7 @@ class WLed : public WGpio {
   WLed* inverted(bool inverted) {
     _config->asBit(BIT_CONFIG_INVERTED, inverted);
     _onChange();
+    wakeUp();
     return this;
   }
 
@@ -0,0 +1,141 @@
+#ifndef W_LED_EFFECTS_H
+#define W_LED_EFFECTS_H
+
+#include <Arduino.h>
+
+#include "WLedLevels.h"
+
+// 50 frames per second at most
+#define LED_FRAME_MILLIS 20
+#define LED_PULSE_PERIOD 3000
+#define LED_RAINBOW_PERIOD 6400
+#define LED_WIPE_MILLIS 40
+#define LED_CHASE_MILLIS 100
+#define LED_CHASE_SPACING 3
+
+/*
+  Animation of a led strip. An effect only depends on the time since start(),
+  so its speed doesn't change with the loop or frame rate. render() writes
+  the complete frame to pixels (0x00RRGGBB), the caller shows it.
+*/
+class WLedEffect {
+ public:
+  virtual ~WLedEffect() {}
+
+  virtual void start(unsigned long now) { _start = now; }
+
+  virtual void render(uint32_t* pixels, uint16_t count, unsigned long now) = 0;
+
+  // Main color of the effect, if it has one
+  void color(uint32_t color) { _color = color; }
+
+  static uint32_t rgb(byte red, byte green, byte blue) { return ((uint32_t)red << 16) | ((uint32_t)green << 8) | blue; }
+
+  // Color wheel: red - green - blue - red
+  static uint32_t wheel(byte position) {
+    byte c;
+    if (position < 85) {
+      c = position * 3;
+      return rgb(c, 255 - c, 0);
+    } else if (position < 170) {
+      c = (position - 85) * 3;
+      return rgb(255 - c, 0, c);
+    } else {
+      c = (position - 170) * 3;
+      return rgb(0, c, 255 - c);
+    }
+  }
+
+  static void fill(uint32_t* pixels, uint16_t count, uint32_t color) {
+    for (uint16_t i = 0; i < count; i++) pixels[i] = color;
+  }
+
+ protected:
+  unsigned long _start = 0;
+  uint32_t _color = 0xFF0000;
+};
+
+// Whole strip in the color, brightness swinging between 1/3 and full
+class WPulseEffect : public WLedEffect {
+ public:
+  WPulseEffect(unsigned long period = LED_PULSE_PERIOD) { _period = period; }
+
+  virtual void render(uint32_t* pixels, uint16_t count, unsigned long now) {
+    // triangle wave 0..255..0 over the period
+    uint32_t phase = ((now - _start) % _period) * 512 / _period;
+    byte t = (phase < 256 ? phase : 511 - phase);
+    fill(pixels, count, WLedLevels::scale(_color, 85 + (170 * t) / 255));
+  }
+
+ private:
+  unsigned long _period;
+};
+
+// Color wheel over the strip (spread) or the whole strip cycling through it
+class WRainbowEffect : public WLedEffect {
+ public:
+  WRainbowEffect(bool spread, unsigned long period = LED_RAINBOW_PERIOD) {
+    _spread = spread;
+    _period = period;
+  }
+
+  virtual void render(uint32_t* pixels, uint16_t count, unsigned long now) {
+    byte offset = ((now - _start) % _period) * 256 / _period;
+    if ((!_spread) || (count == 0)) {
+      fill(pixels, count, wheel(offset));
+      return;
+    }
+    // wheel position in 8.8 fixed point, no division per pixel
+    uint16_t step = 65536UL / count;
+    uint16_t position = (uint16_t)offset << 8;
+    for (uint16_t i = 0; i < count; i++) {
+      pixels[i] = wheel(position >> 8);
+      position += step;
+    }
+  }
+
+ private:
+  bool _spread;
+  unsigned long _period;
+};
+
+// Fills the strip pixel by pixel with the color, then clears it the same way
+class WWipeEffect : public WLedEffect {
+ public:
+  WWipeEffect(unsigned long millisPerPixel = LED_WIPE_MILLIS) { _millisPerPixel = millisPerPixel; }
+
+  virtual void render(uint32_t* pixels, uint16_t count, unsigned long now) {
+    if (count == 0) return;
+    uint32_t step = ((now - _start) / _millisPerPixel) % (2 * (uint32_t)count);
+    bool filling = (step < count);
+    uint16_t edge = (filling ? step : step - count);
+    for (uint16_t i = 0; i < count; i++) pixels[i] = (((i < edge) == filling) ? _color : 0);
+  }
+
+ private:
+  unsigned long _millisPerPixel;
+};
+
+// Every spacing-th pixel lit, moving along the strip
+class WChaseEffect : public WLedEffect {
+ public:
+  WChaseEffect(byte spacing = LED_CHASE_SPACING, unsigned long millisPerStep = LED_CHASE_MILLIS) {
+    _spacing = max(spacing, (byte)2);
+    _millisPerStep = millisPerStep;
+  }
+
+  virtual void render(uint32_t* pixels, uint16_t count, unsigned long now) {
+    byte lit = ((now - _start) / _millisPerStep) % _spacing;
+    byte c = 0;
+    for (uint16_t i = 0; i < count; i++) {
+      pixels[i] = (c == lit ? _color : 0);
+      if (++c == _spacing) c = 0;
+    }
+  }
+
+ private:
+  byte _spacing;
+  unsigned long _millisPerStep;
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef W_LED_LEVELS_H
+#define W_LED_LEVELS_H
+
+#include <Arduino.h>
+
+// Gamma 2.6, perceived brightness of a channel value
+const uint8_t LED_GAMMA[256] PROGMEM = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3,
+    3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 5, 6, 6, 6, 6, 7,
+    7, 7, 8, 8, 8, 9, 9, 9, 10, 10, 10, 11, 11, 11, 12, 12,
+    13, 13, 13, 14, 14, 15, 15, 16, 16, 17, 17, 18, 18, 19, 19, 20,
+    20, 21, 21, 22, 22, 23, 24, 24, 25, 25, 26, 27, 27, 28, 29, 29,
+    30, 31, 31, 32, 33, 34, 34, 35, 36, 37, 38, 38, 39, 40, 41, 42,
+    42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 52, 53, 54, 55, 56, 57,
+    58, 59, 60, 61, 62, 63, 64, 65, 66, 68, 69, 70, 71, 72, 73, 75,
+    76, 77, 78, 80, 81, 82, 84, 85, 86, 88, 89, 90, 92, 93, 94, 96,
+    97, 99, 100, 102, 103, 105, 106, 108, 109, 111, 112, 114, 115, 117, 119, 120,
+    122, 124, 125, 127, 129, 130, 132, 134, 136, 137, 139, 141, 143, 145, 146, 148,
+    150, 152, 154, 156, 158, 160, 162, 164, 166, 168, 170, 172, 174, 176, 178, 180,
+    182, 184, 186, 188, 191, 193, 195, 197, 199, 202, 204, 206, 209, 211, 213, 215,
+    218, 220, 223, 225, 227, 230, 232, 235, 237, 240, 242, 245, 247, 250, 252, 255};
+
+/*
+  Output levels of a strip: brightness and gamma correction. Colors are
+  packed 0xWWRRGGBB, two channels are scaled with one 32 bit multiplication.
+  The gamma table is combined with the brightness into one table in RAM when
+  the brightness changes, so a frame needs one lookup per channel and no
+  float math.
+*/
+class WLedLevels {
+ public:
+  WLedLevels(byte brightness = 255) { this->brightness(brightness); }
+
+  byte brightness() { return _brightness; }
+
+  void brightness(byte brightness) {
+    _brightness = brightness;
+    for (uint16_t i = 0; i < 256; i++) _levels[i] = (pgm_read_byte(&LED_GAMMA[i]) * (brightness + 1)) >> 8;
+  }
+
+  // Brightness only, for colors that are already chosen as they should look
+  uint32_t linear(uint32_t color) { return scale(color, _brightness); }
+
+  uint32_t corrected(uint32_t color) {
+    return ((uint32_t)_levels[color >> 24] << 24) | ((uint32_t)_levels[(color >> 16) & 0xFF] << 16) |
+           ((uint32_t)_levels[(color >> 8) & 0xFF] << 8) | _levels[color & 0xFF];
+  }
+
+  // Applies brightness and, if gamma, the gamma correction to a whole frame in place
+  void apply(uint32_t* pixels, uint16_t count, bool gamma) {
+    if (gamma) {
+      for (uint16_t i = 0; i < count; i++) pixels[i] = corrected(pixels[i]);
+    } else if (_brightness != 255) {
+      for (uint16_t i = 0; i < count; i++) pixels[i] = scale(pixels[i], _brightness);
+    }
+  }
+
+  // color with each channel scaled by level / 255: red and blue, white and green in one multiplication
+  static uint32_t scale(uint32_t color, byte level) {
+    uint32_t rb = ((color & 0x00FF00FF) * (level + 1)) >> 8;
+    uint32_t wg = ((color >> 8) & 0x00FF00FF) * (level + 1);
+    return (rb & 0x00FF00FF) | (wg & 0xFF00FF00);
+  }
+
+ private:
+  byte _brightness;
+  uint8_t _levels[256];
+};
+
+#endif
@@ -28,6 +28,8 @@
 #define MCP4461_INCREMENT 0x4  // 01 left shift by 2
 #define MCP4461_DECREMENT 0x8  // 10 left shift by 2
 #define MCP4461_READ 0xC       // 11 left shift by 2
+// eeprom write cycle of a non volatile wiper, the device doesn't answer meanwhile
+#define MCP4461_EEPROM_WRITE_MILLIS 10
 
 class WMCP444x : public WI2C {
  public:
@@ -39,16 +41,12 @@ class WMCP444x : public WI2C {
   // void setMCP4461Address(uint8_t) {}
 
   bool begin() {
-    Wire.beginTransmission(address());
-    byte error = Wire.endTransmission();
-    return (error == 0);
+    return (_transfer(nullptr, 0) == I2C_OK);
   }
 
   void write(uint8_t wiper, uint8_t value) {
-    Wire.beginTransmission(address());
-    Wire.write(wiper); // write to address 0 
-    Wire.write(value);
-    Wire.endTransmission();   
+    const uint8_t data[] = {wiper, value};
+    _write(data, 2);
   }
 
   void setVolatileWiper(uint8_t wiper, uint16_t wiper_value) {
@@ -78,10 +76,8 @@ class WMCP444x : public WI2C {
     }
     c_byte |= MCP4461_WRITE;
     // send command byte
-    Wire.beginTransmission(address());
-    Wire.write(c_byte);
-    Wire.write(d_byte);
-    Wire.endTransmission();  // do not release bus
+    const uint8_t data[] = {c_byte, d_byte};
+    _write(data, 2);
   }
 
   void setNonVolatileWiper(uint8_t wiper, uint16_t wiper_value) {
@@ -110,12 +106,9 @@ class WMCP444x : public WI2C {
         break;  // not a valid wiper
     }
     c_byte |= MCP4461_WRITE;
-    // send command byte
-    Wire.beginTransmission(address());
-    Wire.write(c_byte);
-    Wire.write(d_byte);
-    Wire.endTransmission();  // do not release bus
-    delay(20);               // allow the write to complete (this is wasteful - better to check if the write has completed)
+    // send command byte, the bus keeps the device idle until the write is complete
+    const uint8_t data[] = {c_byte, d_byte};
+    _write(data, 2, nullptr, MCP4461_EEPROM_WRITE_MILLIS);
   }
 
   void setVolatileWipers(uint16_t wiper_value) {
@@ -126,23 +119,13 @@ class WMCP444x : public WI2C {
   uint16_t getNonVolatileWiper(uint8_t) const {}
 
   uint16_t read_2(byte mem_addr) {
-      uint16_t ret = 0;
-      uint16_t c_byte = 0;
+      uint8_t c_byte = 0;
       c_byte |= MCP4461_STATUS;
       c_byte |= MCP4461_READ;
-      // send command byte
-      Wire.beginTransmission(address());
-      Wire.write(c_byte);
-      Wire.endTransmission(false);  // do not release bus
-      Wire.requestFrom((uint8_t)address(), (uint8_t)2);
-      // read the register
-      int i = 0;
-      while (Wire.available()) {
-          ret |= Wire.read();
-          if (i == 0) ret = ret << 8;
-          i++;
-      }
-      return ret;
+      // send command byte, repeated start and read the register
+      uint8_t result[2] = {0, 0};
+      _transfer(&c_byte, 1, result, 2);
+      return ((uint16_t)result[0] << 8) | result[1];
   }
 
   uint16_t read(uint8_t mem_addr) {
@@ -153,16 +136,20 @@ class WMCP444x : public WI2C {
     byte cmd_byte = 0x0F, highbyte, lowbyte;
     cmd_byte = (mem_addr << 4) | B00001100;
 
-    Wire.beginTransmission(address());
-    Wire.write(cmd_byte);
-    Wire.endTransmission();
-    Wire.requestFrom(address(), 2);
-    Wire.endTransmission();  // stop transmitting
-    if (Wire.available()) {
-      highbyte = Wire.read();  // high byte
-      lowbyte = Wire.read();   // low byte
-      Wire.flush();
+    uint8_t result[2];
+    // waits for queued writes and their eeprom write cycles, like the delay after a write did before
+    unsigned long start = millis();
+    byte error;
+    while (((error = _transfer(&cmd_byte, 1, result, 2)) == I2C_ERROR_BUSY) &&
+           (millis() - start <= (unsigned long)MCP4461_EEPROM_WRITE_MILLIS * I2C_QUEUE_SIZE)) {
+      delay(1);
+    }
+    if (error != I2C_OK) {
+      // no answer
+      return 0x0FFF;
     }
+    highbyte = result[0];
+    lowbyte = result[1];
     uint16_t returnValue = 0;
     returnValue = (((uint16_t)highbyte << 8) | lowbyte) & 0x01FF;
     return returnValue;
@@ -89,12 +89,13 @@ public:
   	}
   }
 
+  // Clock of this device only, the bus switches it per transaction
   void goSlow(){
-  	Wire.setClock(100000L); // set I2C clock to 100kHz
+  	_device.clock(100000L); // set I2C clock to 100kHz
   }
 
   void goFast() {
-  	Wire.setClock(400000L); // set I2C clock to 400kHz
+  	_device.clock(400000L); // set I2C clock to 400kHz
   }
 
   mpr121_error_t getError() {
@@ -18,25 +18,21 @@ class WPCF8575 : public WI2C, public IWExpander {
 
   virtual void loop(unsigned long now) {
     WI2C::loop(now);
-    if (_started) {
-      _i2cPort->requestFrom(_address, (uint8_t)2);
-      _lastReadMillis = millis();
-      if (_i2cPort->available()) {
-        uint16_t iInput = _i2cPort->read();
-        iInput |= _i2cPort->read() << 8;
-        _byteBuffered = (uint16_t)iInput;
-      }
+    if ((_started) && (!_reading) && (now - _lastReadMillis >= READ_ELAPSED_TIME)) {
+      _lastReadMillis = now;
+      _reading = _read(2, [this](byte error, const uint8_t* data, byte length) {
+        _reading = false;
+        if (length == 2) _byteBuffered = data[0] | (data[1] << 8);
+      });
     }
   }
 
   bool begin() {
     _transmissionStatus = 4;
     if (_writeMode > 0 || _readMode > 0) {
-      _i2cPort->beginTransmission(_address);
-      _i2cPort->write((uint8_t)_byteBuffered);
-      _i2cPort->write((uint8_t)(_byteBuffered >> 8));
+      const uint8_t data[] = {(uint8_t)_byteBuffered, (uint8_t)(_byteBuffered >> 8)};
       _byteBuffered = _readModePullUp;
-      _transmissionStatus = _i2cPort->endTransmission();
+      _transmissionStatus = _transfer(data, 2);
     } else {
       LOG->debug(F("IO expander, missing in-/outputs"));
     }
@@ -81,12 +77,8 @@ class WPCF8575 : public WI2C, public IWExpander {
       _byteBuffered = _writeByteBuffered & ~bit(pin);
     }
     if (_started) {
-      _i2cPort->beginTransmission(_address);      
-      _byteBuffered = (_writeByteBuffered & _writeMode) | _readMode;
-      _i2cPort->write((uint8_t)_byteBuffered);
-      _i2cPort->write((uint8_t)(_byteBuffered >> 8));
       _byteBuffered = (_writeByteBuffered & _writeMode) | _readMode;
-      _transmissionStatus = _i2cPort->endTransmission();
+      if (!_writing) _writeOutputs();
       /*if (DEBUG) {        
         _printBinary16(LOG->output(), _byteBuffered);
       }*/
@@ -104,6 +96,21 @@ class WPCF8575 : public WI2C, public IWExpander {
   unsigned long _lastReadMillis = 0;
   uint16_t _writeByteBuffered = 0;
   bool _started = false;
+  bool _reading = false;
+  bool _writing = false;
+  uint16_t _written = 0;
+
+  // One write at a time, outputs changed meanwhile are written after it
+  void _writeOutputs() {
+    _written = (_writeByteBuffered & _writeMode) | _readMode;
+    const uint8_t data[] = {(uint8_t)_written, (uint8_t)(_written >> 8)};
+    _writing = _write(data, 2, [this](byte error, const uint8_t* data, byte length) {
+      _writing = false;
+      _transmissionStatus = error;
+      if (((_writeByteBuffered & _writeMode) | _readMode) != _written) _writeOutputs();
+    });
+    if (!_writing) _transmissionStatus = I2C_ERROR_BUSY;
+  }
 
   void _printBinary16(Print* output, uint16_t value) {
     output->print(F("WPCF8575: write "));
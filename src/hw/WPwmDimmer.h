@@ -2,6 +2,24 @@
 #define W_PWM_DIMMER_H
 
 #include "WDimmer.h"
+#ifdef ARDUINO_ARCH_ESP32
+#include "driver/ledc.h"
+#if __has_include("esp_idf_version.h")
+#include "esp_idf_version.h"
+#endif
+#if defined(ESP_IDF_VERSION_VAL) && (ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 4, 0))
+// a running LEDC fade can be stopped, before fades are stepped in software
+#define PWM_HARDWARE_FADE
+#endif
+#endif
+
+#ifdef ARDUINO_ARCH_ESP8266
+#define PWM_DUTY_MAX 1023
+#else
+#define PWM_FREQUENCY 100000
+#define PWM_RESOLUTION 8
+#define PWM_DUTY_MAX ((1 << PWM_RESOLUTION) - 1)
+#endif
 
 class WPwmDimmer: public WDimmer {
 public:
@@ -17,7 +35,7 @@ public:
 	}
 
 	/*bool isOn() {
-		#ifdef ESP8266
+		#ifdef ARDUINO_ARCH_ESP8266
 		return (analogRead(this->pin()) > 0);
 		#else
 		return ledcRead(_pwmChannel);
@@ -25,6 +43,24 @@ public:
 	}*/
 
 	void loop(unsigned long now) {
+		#ifdef PWM_HARDWARE_FADE
+		if (_isHardwareFade()) {
+			WGpio::loop(now);
+			// The LEDC fades on its own. A running fade is stopped at its current duty,
+			// the new one starts from there like WFade does
+			if ((_isInitialized()) && (_fade.target() != _hardwareTarget)) {
+				_hardwareTarget = _fade.target();
+				ledc_mode_t mode = (ledc_mode_t) (_pwmChannel / 8);
+				ledc_channel_t channel = (ledc_channel_t) (_pwmChannel % 8);
+				if ((long) (now - _hardwareFadeEnd) < 0) ledc_fade_stop(mode, channel);
+				ledc_set_fade_with_time(mode, channel, _duty(_hardwareTarget), _fade.duration());
+				ledc_fade_start(mode, channel, LEDC_FADE_NO_WAIT);
+				_hardwareFadeEnd = now + _fade.duration();
+				WDimmer::_writeLevelCurrent(_hardwareTarget);
+			}
+			return;
+		}
+		#endif
 		WDimmer::loop(now);
 	}
 
@@ -36,37 +72,49 @@ protected:
 	}
 
 	virtual void _onChange() {    
-    if (isInitialized()) {
-      #ifdef ESP8266
-			analogWrite(this->pin(), 0);
+    if (_isInitialized()) {
+      #ifdef ARDUINO_ARCH_ESP8266
+			analogWriteRange(PWM_DUTY_MAX);
+			analogWrite(this->pin(), _duty(_levelCurrent));
 			#else
-			ledcSetup(_pwmChannel, 100000, 8);
+			ledcSetup(_pwmChannel, PWM_FREQUENCY, PWM_RESOLUTION);
 			ledcAttachPin(pin(), _pwmChannel);
-			//ledcWrite(_pwmChannel, 0xFF);
-			ledcWrite(_pwmChannel, 0x30);
-
-			/*ledcSetup(_pwmChannel, 5000, 0x400);
-			ledcAttachPin(pin(), _pwmChannel);
-			ledcWrite(_pwmChannel, 0);*/
+			ledcWrite(_pwmChannel, _duty(_levelCurrent));
+			#ifdef PWM_HARDWARE_FADE
+			// fails harmlessly, if another dimmer installed it already
+			ledc_fade_func_install(0);
+			_hardwareTarget = _levelCurrent;
+			#endif
 			#endif						
     }
   } 
 
-	virtual void _writeLevelCurrent(int levelCurrent) {
-		/*WDimmer::_writeLevelCurrent(levelCurrent);
-		if (isInitialized()) {		
-			levelCurrent = levelCurrent * 0x3FF / 100;
-			#ifdef ESP8266
-				analogWrite(this->pin(), levelCurrent);
+	virtual void _writeLevelCurrent(uint16_t levelCurrent) {
+		WDimmer::_writeLevelCurrent(levelCurrent);
+		if (_isInitialized()) {		
+			#ifdef ARDUINO_ARCH_ESP8266
+				analogWrite(this->pin(), _duty(levelCurrent));
 			#else
-				ledcWrite(_pwmChannel, levelCurrent);
+				ledcWrite(_pwmChannel, _duty(levelCurrent));
 			#endif
-		}*/
+		}
 	}	
 
+	static uint32_t _duty(uint16_t levelCurrent) {
+		return ((uint32_t) levelCurrent * PWM_DUTY_MAX + FADE_MAX / 2) / FADE_MAX;
+	}
+
 private:
 	byte _pwmChannel;
+	#ifdef PWM_HARDWARE_FADE
+	uint16_t _hardwareTarget = 0;
+	unsigned long _hardwareFadeEnd = 0;
 
+	// The LEDC fades the duty linearly, other curves are stepped in software
+	bool _isHardwareFade() {
+		return ((_fade.curve() == FADE_LINEAR) && (_fade.duration() > 0));
+	}
+	#endif
 
 };
 
@@ -3,7 +3,6 @@
 #define W_SHT30_H
 
 #include "hw/WI2CTemperature.h"
-#include "Wire.h"
 #include "WProperty.h"
 
 #define SHT30_ADDRESS 0x44
@@ -37,59 +36,40 @@ class WSht30 : public WI2CTemperature {
 
   virtual void loop(unsigned long now) {
 		WI2CTemperature::loop(now);		
-    if (_state == STH30_STATE_IDLE) {
+		if (_pending) {
+			// request or read queued at the bus
+		} else if (_state == STH30_STATE_IDLE) {
       if ((_lastMeasure == 0) || (now - _lastMeasure > (unsigned long)(_measureInterval))) {
 				// start measurement
       	_lastMeasure = now;
       	_reset();
-      	if (_request(now)) {
-					_state = STH30_STATE_READ;
-				} else {
-					_lastError = ERROR_I2C_REQUEST;
-				}
+      	_request();
 			}
     } else if (_state == STH30_STATE_READ) {
-      if ((now - _lastRequest > I2C_REQUEST_TO_RESULT) && (_i2cPort->requestFrom(address(), 6) == 6)) {				
-				unsigned int data[6];
-        for (int i = 0; i < 6; i++) {
-          data[i] = _i2cPort->read();
-        };
-				_temperatureValue = _temperatureValue + (((((data[0] * 256.0) + data[1]) * 175) / 65535.0) - 45);        
-        _humidityValue = _humidityValue + ((((data[3] * 256.0) + data[4]) * 100) / 65535.0);        
-				_counter++;		
-				if (_counter < SHT30_AVERAGE_COUNTS) {														
-					_state = STH30_STATE_READ_PAUSED;
-				} else {
-					_temperatureValue = _temperatureValue / (double) SHT30_AVERAGE_COUNTS;							
-					if (hasProperty()) {
-						property()->asDouble(_temperatureValue + _correctionTemperature);				
-					}				
-					_humidityValue = _humidityValue / (double) SHT30_AVERAGE_COUNTS;
-					if (hasHumidity()) {
-						humidity()->asDouble(_humidityValue + _correctionHumidity);
-					}
-					_lastMeasure = now;
-        	_reset(); //IDLE		
-					_lastError = ERROR_NONE;			
-				}	
-      } else if (now - _lastRequest > I2C_TIMEOUT) {
+      if (now - _lastRequest > I2C_TIMEOUT) {
         // Timeout
         _reset();
         _lastError = ERROR_I2C_TIMEOUT;
-      }
+      } else if (now - _lastRequest > I2C_REQUEST_TO_RESULT) {
+				_pending = _read(6, [this](byte error, const uint8_t* data, byte length) {
+					_pending = false;
+					// without result, it's read again until timeout
+					if (length == 6) _result(data);
+				});
+			}
     } else {
 			//STH30_STATE_READ_PAUSED
 			if (now - _lastRequest > I2C_BETWEEN) {
-				if (_request(now)) {
-					_state = STH30_STATE_READ;
-				} else {
-					_reset();
-					_lastError = ERROR_I2C_REQUEST;
-				}
+				_request();
 			}	
 		}
   }
 
+  virtual unsigned long nextLoop(unsigned long now) {
+    // between measurements nothing to do
+    return ((_state == STH30_STATE_IDLE) && (!_pending) && (_lastMeasure != 0) ? _lastMeasure + _measureInterval + 1 : now);
+  }
+
 	WProperty* humidity() { return _humidity; }
 
   void setHumidity(WProperty* humidity) {
@@ -108,6 +88,7 @@ class WSht30 : public WI2CTemperature {
   double _temperatureValue, _humidityValue;
 	double _correctionTemperature, _correctionHumidity;
   byte _counter;
+  bool _pending = false;
 
   void _reset() {
     _state = STH30_STATE_IDLE;
@@ -117,17 +98,44 @@ class WSht30 : public WI2CTemperature {
     _counter = 0;
   }
 
-	byte _request(unsigned long now) {				
-		_i2cPort->beginTransmission(_address);      
-    _i2cPort->write(0x2C);
-    _i2cPort->write(0x06);      
-    if (_i2cPort->endTransmission() == 0) {
-			_lastRequest = now;
-			return true;
-		} else {
-			return false;
+	void _request() {
+		const uint8_t command[] = {0x2C, 0x06};
+		_pending = _write(command, 2, [this](byte error, const uint8_t* data, byte length) {
+			_pending = false;
+			if (error == I2C_OK) {
+				_lastRequest = millis();
+				_state = STH30_STATE_READ;
+			} else {
+				_reset();
+				_lastError = ERROR_I2C_REQUEST;
+			}
+		});
+		if (!_pending) {
+			_reset();
+			_lastError = ERROR_I2C_REQUEST;
 		}
-	}	
+	}
+
+	void _result(const uint8_t* data) {
+		_temperatureValue = _temperatureValue + (((((data[0] * 256.0) + data[1]) * 175) / 65535.0) - 45);        
+		_humidityValue = _humidityValue + ((((data[3] * 256.0) + data[4]) * 100) / 65535.0);        
+		_counter++;		
+		if (_counter < SHT30_AVERAGE_COUNTS) {														
+			_state = STH30_STATE_READ_PAUSED;
+		} else {
+			_temperatureValue = _temperatureValue / (double) SHT30_AVERAGE_COUNTS;							
+			if (hasProperty()) {
+				property()->asDouble(_temperatureValue + _correctionTemperature);				
+			}				
+			_humidityValue = _humidityValue / (double) SHT30_AVERAGE_COUNTS;
+			if (hasHumidity()) {
+				humidity()->asDouble(_humidityValue + _correctionHumidity);
+			}
+			_lastMeasure = millis();
+			_reset(); //IDLE		
+			_lastError = ERROR_NONE;			
+		}	
+	}
 };
 
 #endif
@@ -32,64 +32,30 @@ class WSwitch : public WGpio {
 
   void loop(unsigned long now) {
     if (_isInitialized()) {
-      // 1. Eliminate flickering input
-      bool stateChanged = false;
-      bool newState = readInput(pin());  
-      bool expectedPegel = (_type == GPIO_TYPE_SWITCH ? !_state : _onLevel());
-      unsigned long sensitiveness = (_type == GPIO_TYPE_SWITCH ? SWITCH_SENSITIVENESS : BUTTON_SENSITIVENESS);
-
-      if ((newState != _lastState) && (_startTime == 0)) {
-        _startTime = now;
-      } else if ((newState == _state) && (_startTime > 0)) {
-        _startTime = now;
-      } else if ((newState != _state) && (now - _startTime >= sensitiveness)) {
-        stateChanged = true;
-      }
-
-      _lastState = newState;
-      // 2. If state really changed, now switch logic
-      if (stateChanged) {                
-        _state = !_state;
-        _startTime = 0;
-        if (_state == expectedPegel) {
-          if (_type == GPIO_TYPE_BUTTON) {            
-            // Button handling
-            if (!supportLongPress()) {
-              // Button
-              handleButtonOrSwitchPressed();
-              _longPressStartTime = 0;
-            } else {
-              _longPressStartTime = now;
-            }
-          } else {
-            // Switch handling
-            handleButtonOrSwitchPressed();
-            _longPressStartTime = 0;
-          }
-        } else {
-          if (_type == GPIO_TYPE_BUTTON) {    
-            if ((supportLongPress()) && (_longPressStartTime > 0) && (now - _longPressStartTime < SWICTH_LONG_PRESS_DURATION)) {
-              // Long press button was released before long press time
-              handleButtonOrSwitchPressed();
-            } 
-          } else {              
-            // Switch handling
-            handleButtonOrSwitchPressed();                      
-          }
-          _longPressStartTime = 0;
+      if (_edges != nullptr) {
+        // replay the recorded edges at their time, so short presses are not missed if the loop stalls
+        WEdge edge;
+        while (_edges->pop(edge)) {
+          // input kept its level until the edge
+          _sample(_lastState, edge.time);
+          _sample(bitRead(edge.level, 0), edge.time);
         }
+        _sample((_edges->overflowed() ? readInput(pin()) : _lastState), now);
       } else {
-        // 3. If state not changed, reset trigger and handle long press buttons
-        setTriggerValue(false);
-        // Long press time is up
-        if ((supportLongPress()) && (_longPressStartTime > 0) && (now - _longPressStartTime >= SWICTH_LONG_PRESS_DURATION)) {
-          handleLongButtonPressed();
-          _longPressStartTime = 0;
-        }
+        _sample(readInput(pin()), now);
       }
     }
   }
 
+  // Pin change interrupt instead of polling, not possible with expanders
+  WSwitch* useInterrupt(bool useInterrupt) {
+    _useEdges(useInterrupt);
+    if (_isInitialized()) {
+      _lastState = readInput(pin());
+    }
+    return this;
+  }
+
   bool inverted() { return bitRead(_config->asByte(), BIT_CONFIG_INVERTED); }
 
   WSwitch* inverted(bool inverted) {
@@ -173,6 +139,64 @@ class WSwitch : public WGpio {
   unsigned long _longPressStartTime = 0;
   WProperty* _triggerProperty;
 
+  // one step of the debounce and long press logic for the input level at time now
+  void _sample(bool newState, unsigned long now) {
+    // 1. Eliminate flickering input
+    bool stateChanged = false;
+    bool expectedPegel = (_type == GPIO_TYPE_SWITCH ? !_state : _onLevel());
+    unsigned long sensitiveness = (_type == GPIO_TYPE_SWITCH ? SWITCH_SENSITIVENESS : BUTTON_SENSITIVENESS);
+
+    if ((newState != _lastState) && (_startTime == 0)) {
+      _startTime = now;
+    } else if ((newState == _state) && (_startTime > 0)) {
+      _startTime = now;
+    } else if ((newState != _state) && (now - _startTime >= sensitiveness)) {
+      stateChanged = true;
+    }
+
+    _lastState = newState;
+    // 2. If state really changed, now switch logic
+    if (stateChanged) {                
+      _state = !_state;
+      _startTime = 0;
+      if (_state == expectedPegel) {
+        if (_type == GPIO_TYPE_BUTTON) {            
+          // Button handling
+          if (!supportLongPress()) {
+            // Button
+            handleButtonOrSwitchPressed();
+            _longPressStartTime = 0;
+          } else {
+            _longPressStartTime = now;
+          }
+        } else {
+          // Switch handling
+          handleButtonOrSwitchPressed();
+          _longPressStartTime = 0;
+        }
+      } else {
+        if (_type == GPIO_TYPE_BUTTON) {    
+          if ((supportLongPress()) && (_longPressStartTime > 0) && (now - _longPressStartTime < SWICTH_LONG_PRESS_DURATION)) {
+            // Long press button was released before long press time
+            handleButtonOrSwitchPressed();
+          } 
+        } else {              
+          // Switch handling
+          handleButtonOrSwitchPressed();                      
+        }
+        _longPressStartTime = 0;
+      }
+    } else {
+      // 3. If state not changed, reset trigger and handle long press buttons
+      setTriggerValue(false);
+      // Long press time is up
+      if ((supportLongPress()) && (_longPressStartTime > 0) && (now - _longPressStartTime >= SWICTH_LONG_PRESS_DURATION)) {
+        handleLongButtonPressed();
+        _longPressStartTime = 0;
+      }
+    }
+  }
+
   void setTriggerValue(bool triggered) {
     if (_triggerProperty != nullptr) {
       _triggerProperty->asBool(triggered);